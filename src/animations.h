@@ -3,8 +3,6 @@
 
 #include "colors.h"
 
-void localButtonProcess(uint64_t pressed, uint64_t longPressed);
-
 void startAnimationScanBase(uint64_t expiration=0, uint32_t color=colorHiRed);
 inline void startAnimationScan() { startAnimationScanBase(); }
 void stopAnimationScan();
@@ -0,0 +1,106 @@
+#include "automaton.h"
+#include "bitboard.h"
+#include "prng.h"
+#include "common.h"
+
+#include <ctype.h>
+
+// The whole board is stepped at once: the 8 neighbor boards are added up bit-sliced,
+// so every cell gets its neighbor count in 4 planes (1s, 2s, 4s and 8s) from a handful
+// of 64 bit ops. There is no loop over cells, only over neighbor counts in the rule.
+
+static const int automatonMaxNeighbors = 8;
+
+static inline void addNeighbors(uint64_t neighbors, uint64_t planes[4])
+{
+  for (int i = 0; i < 4 && neighbors; ++i)
+  {
+    const uint64_t carry = planes[i] & neighbors;
+    planes[i] ^= neighbors;
+    neighbors = carry;
+  }
+}
+
+uint64_t automatonStep(uint64_t board, uint16_t birth, uint16_t survive, bool wrap)
+{
+  const uint64_t east = wrap ? bitboardScrollEast(board) : bitboardEast(board);
+  const uint64_t west = wrap ? bitboardScrollWest(board) : bitboardWest(board);
+  const uint64_t row[] = {east, board, west};
+  uint64_t planes[4] = {0};
+  for (const uint64_t columns : row)
+  {
+    addNeighbors(wrap ? bitboardScrollNorth(columns) : bitboardNorth(columns), planes);
+    addNeighbors(wrap ? bitboardScrollSouth(columns) : bitboardSouth(columns), planes);
+  }
+  addNeighbors(east, planes);
+  addNeighbors(west, planes);
+
+  uint64_t result = 0;
+  for (int count = 0; count <= automatonMaxNeighbors; ++count)
+  {
+    const uint16_t countBit = 1 << count;
+    if (!((birth | survive) & countBit))
+      continue;
+    uint64_t cells = ~0ULL;
+    for (int i = 0; i < 4; ++i)
+      cells &= (count & (1 << i)) ? planes[i] : ~planes[i];
+    if (birth & countBit)
+      result |= cells & ~board;
+    if (survive & countBit)
+      result |= cells & board;
+  }
+  return result;
+}
+
+static const char *parseCounts(const char *rule, char prefix, uint16_t &counts)
+{
+  if (*rule != prefix && *rule != tolower(prefix))
+    return nullptr;
+  counts = 0;
+  for (++rule; *rule >= '0' && *rule <= '0' + automatonMaxNeighbors; ++rule)
+    counts |= 1 << (*rule - '0');
+  return rule;
+}
+
+bool automatonParseRule(const char *rule, LightUnitAutomaton &automaton)
+{
+  LightUnitAutomaton parsed = {0};
+  rule = parseCounts(rule, 'B', parsed.birth);
+  if (rule == nullptr || *rule++ != '/')
+    return false;
+  rule = parseCounts(rule, 'S', parsed.survive);
+  if (rule == nullptr)
+    return false;
+  if (*rule == ':')
+  {
+    ++rule;
+    if (*rule != 'T' && *rule != 't')
+      return false;
+    parsed.wrap = true;
+    ++rule;
+  }
+  if (*rule)
+    return false;
+
+  automaton = parsed;
+  return true;
+}
+
+uint64_t automatonNext(LightUnit &unit)
+{
+  const LightUnitAutomaton &automaton = unit.payload.automaton;
+  LightUnitState &unitState = unit.state;
+  const uint64_t board = unit.pixelMask;
+  uint64_t next = automatonStep(board, automaton.birth, automaton.survive, automaton.wrap);
+
+  // Stagnant: died out, still life or a blinker (same as 2 generations ago)
+  if (next == 0 || next == board || next == unitState.kindVars[0])
+  {
+    next = prngNext(unitState.rng);
+    unitState.kindStep = 0;
+  }
+  else
+    ++unitState.kindStep;
+  unitState.kindVars[0] = board;
+  return next;
+}
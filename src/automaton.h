@@ -0,0 +1,16 @@
+#ifndef _AUTOMATON_H
+
+#define _AUTOMATON_H
+
+#include "lightUnit.h"
+
+// next generation of board. Bit n of birth/survive => a cell with n live neighbors is born/survives
+uint64_t automatonStep(uint64_t board, uint16_t birth, uint16_t survive, bool wrap);
+
+// parses a rule like "B3/S23" (Life), with an optional ":T" suffix to wrap around the edges
+bool automatonParseRule(const char *rule, LightUnitAutomaton &automaton);
+
+// moves unit to its next generation, seeding it again when it is empty or stagnant
+uint64_t automatonNext(LightUnit &unit);
+
+#endif // _AUTOMATON_H
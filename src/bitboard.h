@@ -0,0 +1,76 @@
+#ifndef _BITBOARD_H
+
+#define _BITBOARD_H
+
+#include <inttypes.h>
+
+// The 8x8 grid maps onto a single uint64_t: bit i is button/pixel i, where i = y * 8 + x.
+// Moving the whole board around is a shift, masked so bits do not wrap into the next row.
+
+static const uint64_t bitboardColumn0 = 0x0101010101010101ULL; // x == 0
+static const uint64_t bitboardColumn7 = 0x8080808080808080ULL; // x == 7
+
+inline uint64_t bitboardBit(int index) { return 1ULL << index; }
+inline int bitboardX(int index) { return index & 7; }
+inline int bitboardY(int index) { return index >> 3; }
+inline int bitboardCount(uint64_t board) { return __builtin_popcountll(board); }
+inline int bitboardFirst(uint64_t board) { return board ? __builtin_ctzll(board) : -1; }
+
+inline uint64_t bitboardEast(uint64_t board) { return (board << 1) & ~bitboardColumn0; }  // x + 1
+inline uint64_t bitboardWest(uint64_t board) { return (board >> 1) & ~bitboardColumn7; }  // x - 1
+inline uint64_t bitboardNorth(uint64_t board) { return board >> 8; }                     // y - 1
+inline uint64_t bitboardSouth(uint64_t board) { return board << 8; }                     // y + 1
+
+// all 8 surrounding bits of every bit set in board, excluding board itself
+inline uint64_t bitboardNeighbors(uint64_t board)
+{
+  const uint64_t row = board | bitboardEast(board) | bitboardWest(board);
+  return (row | bitboardNorth(row) | bitboardSouth(row)) & ~board;
+}
+
+inline bool bitboardAdjacent(int index, int otherIndex)
+{
+  return (bitboardNeighbors(bitboardBit(index)) & bitboardBit(otherIndex)) != 0;
+}
+
+// Scrolls: bits that fall off one edge come back on the opposite edge
+inline uint64_t bitboardScrollEast(uint64_t board) { return ((board << 1) & ~bitboardColumn0) | ((board >> 7) & bitboardColumn0); }
+inline uint64_t bitboardScrollWest(uint64_t board) { return ((board >> 1) & ~bitboardColumn7) | ((board << 7) & bitboardColumn7); }
+inline uint64_t bitboardScrollNorth(uint64_t board) { return (board >> 8) | (board << 56); }
+inline uint64_t bitboardScrollSouth(uint64_t board) { return (board << 8) | (board >> 56); }
+
+// Mirror rows: every row is a byte, so that is a byte swap
+inline uint64_t bitboardFlipVertical(uint64_t board) { return __builtin_bswap64(board); }
+
+// Mirror columns: reverse the bits within each byte
+inline uint64_t bitboardFlipHorizontal(uint64_t board)
+{
+  const uint64_t k1 = 0x5555555555555555ULL;
+  const uint64_t k2 = 0x3333333333333333ULL;
+  const uint64_t k4 = 0x0f0f0f0f0f0f0f0fULL;
+  board = ((board >> 1) & k1) | ((board & k1) << 1);
+  board = ((board >> 2) & k2) | ((board & k2) << 2);
+  return ((board >> 4) & k4) | ((board & k4) << 4);
+}
+
+// Swap x and y, by swapping 4x4, 2x2 and 1x1 blocks across the diagonal
+// ref: https://www.chessprogramming.org/Flipping_Mirroring_and_Rotating
+inline uint64_t bitboardTranspose(uint64_t board)
+{
+  const uint64_t k1 = 0x5500550055005500ULL;
+  const uint64_t k2 = 0x3333000033330000ULL;
+  const uint64_t k4 = 0x0f0f0f0f00000000ULL;
+  uint64_t t = k4 & (board ^ (board << 28));
+  board ^= t ^ (t >> 28);
+  t = k2 & (board ^ (board << 14));
+  board ^= t ^ (t >> 14);
+  t = k1 & (board ^ (board << 7));
+  return board ^ t ^ (t >> 7);
+}
+
+// Rotations are clockwise, with button 1 (bit 0) at the top left corner
+inline uint64_t bitboardRotate90(uint64_t board) { return bitboardFlipHorizontal(bitboardTranspose(board)); }
+inline uint64_t bitboardRotate180(uint64_t board) { return bitboardFlipVertical(bitboardFlipHorizontal(board)); }
+inline uint64_t bitboardRotate270(uint64_t board) { return bitboardFlipVertical(bitboardTranspose(board)); }
+
+#endif // _BITBOARD_H
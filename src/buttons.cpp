@@ -1,11 +1,16 @@
 #include "buttons.h"
 #include "common.h"
-#include "animations.h"
+#include "gestures.h"
+#include "keyStats.h"
+#include "reactions.h"
 #include "tickerScheduler.h"
 
-extern const uint32_t minPressThreshold = 2;   // 0.2 seconds
-extern const uint32_t longPressThreshold = 24; // 2.4 seconds
-extern const uint32_t maxPressThreshold = 150; // 15 seconds
+static const uint32_t defaultMinPressMs = 200;    // 0.2 seconds
+static const uint32_t defaultLongPressMs = 2400;  // 2.4 seconds
+static const uint32_t defaultMaxPressMs = 15000; // 15 seconds
+
+// Lower bound of the first bucket. Every bucket after it doubles that
+static const uint32_t holdHistogramFirstMs = 100;
 
 TrellisCallback keyPressCallback(keyEvent evt)
 {
@@ -15,12 +20,18 @@ TrellisCallback keyPressCallback(keyEvent evt)
 
   const int buttonIndex = (int)evt.bit.NUM;
   const uint64_t prevPressed = state.buttons.pressed;
+  if (buttonIndex < 0 || buttonIndex >= Y_DIM * X_DIM)
+    return 0;
   if (evt.bit.EDGE == SEESAW_KEYPAD_EDGE_RISING)
   {
     setFlag(state.buttons.pressed, buttonIndex);
+    state.buttons.pressMillis[buttonIndex] = millis();
   }
   else
+  {
     clearFlag(state.buttons.pressed, buttonIndex);
+    state.buttons.releaseMillis[buttonIndex] = millis();
+  }
 
   if (prevPressed != state.buttons.pressed)
   {
@@ -49,30 +60,89 @@ TrellisCallback keyPressCallback(keyEvent evt)
   return 0;
 }
 
-inline static void _bumpCounter(uint32_t &counter)
+uint32_t buttonHeldMs(int buttonIndex, uint32_t now)
 {
-  if (counter < 0xfffffffeUL)
+  // If button is in the aborted mask, pretend it is held for too long to make that known.
+  // This is expected to happend when button was stuck before and then it got
+  // unstuck but no notifications about it was sent out yet.
+  if (getFlag(state.buttons.abortedPendingPressEvent, buttonIndex))
+    return state.maxPressMs;
+  return now - state.buttons.pressMillis[buttonIndex];
+}
+
+static void holdHistogramAdd(int buttonIndex, uint32_t heldMs)
+{
+  size_t bucket = 0;
+  for (uint32_t limit = holdHistogramFirstMs; bucket < holdHistogramBuckets - 1 && heldMs >= limit; limit *= 2)
+    ++bucket;
+  uint16_t &counter = state.buttons.holdHistogram[buttonIndex][bucket];
+  if (counter < 0xffff)
     ++counter;
 }
 
-void buttons100msTick()
+static const char *const buttonKeyEventNames[] = {"press", "long", "release", "stuck"};
+
+void buttonKeyEvent(int buttonIndex, ButtonKeyEvent keyEvent)
 {
-  if (state.buttons.pressed)
+  ButtonsState &buttons = state.buttons;
+  uint32_t eventMillis = millis();
+  uint32_t heldMs = 0;
+  switch (keyEvent)
   {
-    for (int i = 0; i < 64; ++i)
+  case buttonKeyEventPress:
+    // Note: handle press and release that happened before the fast tick saw them
+    if (!setFlag(buttons.pressEventSent, buttonIndex))
+      return;
+    eventMillis = buttons.pressMillis[buttonIndex];
+    break;
+  case buttonKeyEventLongPress:
+    if (!setFlag(buttons.longPressEventSent, buttonIndex))
+      return;
+    clearFlag(buttons.reactionFeedback, buttonIndex); // long press animation takes over
+    break;
+  case buttonKeyEventRelease:
+    if (!getFlag(buttons.pressEventSent, buttonIndex))
+      buttonKeyEvent(buttonIndex, buttonKeyEventPress);
+    // fall through
+  case buttonKeyEventStuck:
+    clearFlag(buttons.pressEventSent, buttonIndex);
+    clearFlag(buttons.longPressEventSent, buttonIndex);
+    clearFlag(buttons.reactionFeedback, buttonIndex);
+    if (keyEvent == buttonKeyEventRelease)
+      eventMillis = buttons.releaseMillis[buttonIndex];
+    heldMs = eventMillis - buttons.pressMillis[buttonIndex];
+    holdHistogramAdd(buttonIndex, heldMs);
+    keyStatsAdd(buttonIndex, keyEvent, heldMs);
+    break;
+  }
+
+  // Reactions go first: lights must not wait for the broker
+  const int32_t lightMs = reactionsKeyEvent(buttonIndex, keyEvent, eventMillis);
+  if (lightMs >= 0 && keyEvent == buttonKeyEventPress)
+    setFlag(buttons.reactionFeedback, buttonIndex);
+  if (keyEvent == buttonKeyEventPress || keyEvent == buttonKeyEventRelease)
+    swipeKeyEdge(buttonIndex, keyEvent == buttonKeyEventPress, eventMillis);
+
+  if (!state.immediateButtonEvents)
+    return;
+  const uint16_t seq = ++buttons.keyEventSeq[buttonIndex];
+  queueButtonKeyEvent(buttonIndex, buttonKeyEventNames[keyEvent], eventMillis, seq, heldMs, lightMs);
+}
+
+void buttonPressEvents(uint64_t pressedMask)
+{
+  // Note: presses seen by the same fast tick go out in the order they happened, not by index
+  while (pressedMask)
+  {
+    int first = -1;
+    for (int i = 0; i < Y_DIM * X_DIM; ++i)
     {
-      if (getFlag(state.buttons.pressed, i))
-        _bumpCounter(state.buttons.buttonPressedCounter[i]);
-
-      // If button is in the aborted mask, baseline its counter to make that known.
-      // This is expected to happend when button was stuck before and then it got
-      // unstuck but no notifications about it was sent out yet.
-      if (getFlag(state.buttons.abortedPendingPressEvent, i) &&
-          state.buttons.buttonPressedCounter[i] < maxPressThreshold)
-      {
-        state.buttons.buttonPressedCounter[i] = maxPressThreshold;
-      }
+      if (getFlag(pressedMask, i) &&
+          (first < 0 || (int32_t)(state.buttons.pressMillis[i] - state.buttons.pressMillis[first]) < 0))
+        first = i;
     }
+    clearFlag(pressedMask, first);
+    buttonKeyEvent(first, buttonKeyEventPress);
   }
 }
 
@@ -111,14 +181,18 @@ void buttons1secTick()
   // Reset all values after sending event
   state.buttons.pendingPressEvent = 0;
   state.buttons.pendingLongPressEvent = 0;
+  lightsRedrawPixels(state.buttons.abortedPendingPressEvent); // no longer painted red
   state.buttons.abortedPendingPressEvent = 0;
 }
 
 void initButtons(TickerScheduler &ts)
 {
+  state.minPressMs = defaultMinPressMs;
+  state.longPressMs = defaultLongPressMs;
+  state.maxPressMs = defaultMaxPressMs;
+
   // Init tickers
   const uint32_t oneSec = 1000;
 
-  ts.sched(buttons100msTick, 100);
   ts.sched(buttons1secTick, oneSec);
 }
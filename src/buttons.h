@@ -9,8 +9,18 @@ extern TrellisCallback keyPressCallback(keyEvent evt);
 #define Y_DIM 8 // number of rows of key
 #define X_DIM 8 // number of columns of keys
 
-extern const uint32_t minPressThreshold;
-extern const uint32_t longPressThreshold;
-extern const uint32_t maxPressThreshold;
+// how long button has been held down, based on the timestamp of its edge
+uint32_t buttonHeldMs(int buttonIndex, uint32_t now);
+
+typedef enum ButtonKeyEvent_t
+{
+  buttonKeyEventPress,     // button went down
+  buttonKeyEventLongPress, // button is held down for longer than state.longPressMs
+  buttonKeyEventRelease,   // button went up
+  buttonKeyEventStuck,     // button is held down for longer than state.maxPressMs
+} ButtonKeyEvent;
+
+void buttonKeyEvent(int buttonIndex, ButtonKeyEvent keyEvent);
+void buttonPressEvents(uint64_t pressedMask); // press events of these buttons, oldest press first
 
 #endif // _BUTTONS_H
@@ -23,29 +23,82 @@ void parseOnOffToggle(const char *subName, const char *message,
                       OnOffToggle togglePtr);
 void gameOver(const char *const msg);
 
+// Rolling window of samples, used for reporting latency percentiles
+static const size_t latencyStatsWindow = 64;
+typedef struct
+{
+  uint32_t samples[latencyStatsWindow];
+  uint32_t count; // total number of samples added
+} LatencyStats;
+void latencyStatsAdd(LatencyStats &stats, uint32_t sample);
+uint32_t latencyStatsPercentile(const LatencyStats &stats, uint32_t percentile);
+
+// Flash wear limits of a blob in nvs: never write the same content twice and never more
+// often than nvWearMinSaveIntervalMs. A save asked for sooner is left pending for a tick
+static const uint32_t nvWearMinSaveIntervalMs = 60 * 1000UL;
+typedef struct
+{
+  const char *key;
+  uint32_t savedHash; // of what is in nvs (0 => unknown)
+  uint32_t savedMillis;
+  bool savedMillisValid;
+  bool saveIsPending;
+} NvWear;
+uint32_t nvWearHash(const uint8_t *blob, size_t blobSize);
+bool nvWearSaveIsDue(NvWear &wear); // false => too soon, left pending
+bool nvWearPutBytes(NvWear &wear, const uint8_t *blob, size_t blobSize); // false => unchanged or failed
+
 // FWDs decls... lights (aka trellis)
 void initTrellis(TickerScheduler &ts);
 void clearLights(bool callTrellisShow);
+void showLights();
+uint32_t lightsWheel(uint8_t wheelPos); // rainbow color, going r - g - b - back to r
+uint32_t lightsClockMs(); // animation time. Stands still while paused and runs slower when scaled
+void lightsClockPause(bool paused);
+void lightsClockScale(uint32_t timeScale); // percent of real time, from 1 to 100
+void lightUnitRenderNow(int /*LightUnitId*/ id); // draw first frame without waiting for refresh
 uint64_t getActivePixels();
+void lightsRedrawPixels(uint64_t pixels); // blends them again on the next fast tick
+uint32_t lightsOccludedUnits();  // unit frames that skipped their color, as units above hid them (last minute)
+uint32_t lightsOccludedPixels(); // pixels that were not blended again, as units above hid them (last minute)
 uint32_t lightUnitsSize();
-void lightUnitFinalIteration(void * /*LightUnit**/ lightUnitPtr,
-                             bool callTrellisShow = true);
+void lightUnitFinalIteration(void * /*LightUnit**/ lightUnitPtr); // drops its pixels from the frame
 
 // FWS decls... buttons
 void initButtons(TickerScheduler &ts);
 
+// FWS decls... scenes
+void initScenes(TickerScheduler &ts); // restores saved scene, if autoRestore is on
+void sceneSaveRequest();
+bool sceneLoad();
+void sceneSetAutoRestore(bool autoRestore);
+
 // FWS decls... mqtt_client
 void initMyMqtt(TickerScheduler &ts);
 void myMqttLoop();
 void nvClearRequest();
 
 bool sendButtonEvent();
+// Note: key events are published by myMqttLoop, ordered by eventMillis, so the caller never waits on the broker
+void queueButtonKeyEvent(int buttonIndex, const char *eventName, uint32_t eventMillis,
+                         uint16_t seq, uint32_t heldMs, int32_t lightMs);
+bool sendButtonKeyEvents();
 bool sendOperState();
+bool sendHoldHistogram(int buttonIndex); // -1 => all buttons combined
+bool sendKeyStats(int buttonIndex);      // -1 => all buttons that were used
+bool sendSwipeEvent(const char *eventName, const char *direction, int fromKey, int toKey,
+                    uint64_t path, uint32_t durationMs);
+bool sendCmdAcks();
+bool cmdAcksPending();                        // acks waiting for a trellis.show()
+void cmdAckRendered(uint32_t refreshStartUs); // called once frame is pushed to trellis
 bool isMqttConnected(); // true when mqtt connection is up
 
 // FWS decls... msgHandler
 void initCmdOpHandlers();
-void parseMqttCmd(const char *msg, size_t msgSize);
+bool parseMqttCmd(const char *msg, size_t msgSize, uint32_t *seqPtr = nullptr); // true if msg has seq
+bool runCmdOp(const char *op); // run op handler without any other cmd attributes
+
+static const size_t holdHistogramBuckets = 8;
 
 typedef struct
 {
@@ -53,13 +106,22 @@ typedef struct
   uint64_t pressed;
   // Mask with buttons that changed since last trellisFastTick call
   uint64_t changedState;
-  // Counter for every button that goes up while pressed
-  uint32_t buttonPressedCounter[64];
 
   // Masks that keep tabs on the buttons that:
-  uint64_t pendingPressEvent;        // was pressed for longer than minPressThreshold
-  uint64_t pendingLongPressEvent;    // was pressed for longer than longPressThreshold
-  uint64_t abortedPendingPressEvent; // was pressed for longer than maxPressThreshold
+  uint64_t pendingPressEvent;        // was pressed for longer than minPressMs
+  uint64_t pendingLongPressEvent;    // was pressed for longer than longPressMs
+  uint64_t abortedPendingPressEvent; // was pressed for longer than maxPressMs
+
+  // Immediate (per key) events helpers
+  uint32_t pressMillis[64];    // when button last went down
+  uint32_t releaseMillis[64];  // when button last went up
+  uint16_t keyEventSeq[64];    // bumped on every event sent for the button
+  uint64_t pressEventSent;     // buttons down for which a press event was sent
+  uint64_t longPressEventSent; // buttons down for which a long press event was sent
+  uint64_t reactionFeedback;   // buttons down lit by a reaction, instead of press animation
+
+  // How long buttons were held, in buckets of 0.1, 0.2, 0.4, ... 6.4+ seconds
+  uint16_t holdHistogram[64][holdHistogramBuckets];
 } ButtonsState;
 
 typedef struct
@@ -75,6 +137,13 @@ typedef struct
   size_t msgBufferSize;                 // constant and used as sanity
   size_t largestMsgSize;                // high watermark
   uint32_t minutes_since_periodic_ping; // dog
+
+  // runtime knobs, set via cmd op "cfg"
+  bool compactOperState; // publish a single 'state' msg instead of battery, uptime, memory and etc
+  bool immediateButtonEvents; // publish 'key' msg as soon as each button event is detected
+  uint32_t minPressMs;        // shorter presses are ignored
+  uint32_t longPressMs;       // presses longer than this are long presses (purple)
+  uint32_t maxPressMs;        // presses longer than this are considered stuck buttons
 } State;
 
 extern State state;
@@ -0,0 +1,377 @@
+#include "common.h"
+#include "gestures.h"
+#include "wifiConfig.h"
+#include "tickerScheduler.h"
+
+#include <Preferences.h>
+#include <unordered_map>
+#include <vector>
+
+// Gestures are ordered lists of chords, reported by buttons1secTick as (pressed, longPressed)
+// masks. They get compiled into a trie, where each edge is looked up in a hash map keyed
+// on (parent node, chord). That makes matching a report O(1), regardless of table size.
+
+static const char *const ATTR_GESTURES = "gestures";
+static const uint16_t gesturesMagic = 0x4754; // "GT"
+static const uint8_t gesturesVersion = 2;
+static const size_t gesturesMaxSize = 48;
+static const size_t gesturesHeaderSize = 2 + 1 + 1;
+// steps count, steps and action length, then the action
+static const size_t gestureMaxBlobSize = 1 + gestureMaxSteps * (8 + 8) + 1 + gestureActionSize - 1;
+
+// how long to wait for the next step of a multi step gesture
+static const uint32_t gestureStepTimeoutMs = 10 * 1000UL;
+
+static const Gesture defaultGestures[] = {
+    {1, {{0x0000000000000000ULL, 0x8100000000000081ULL}}, "nvClear"},
+    {1, {{0x0000000000000000ULL, 0x0000000000000080ULL}}, "flashlight"},
+    {1, {{0x0000000000000040ULL, 0x0000000000000080ULL}}, "flashlight2"},
+    {1, {{0x0000000000000020ULL, 0x0000000000000080ULL}}, "flashlight3"},
+    {1, {{0x0000000000000010ULL, 0x0000000000000080ULL}}, "flashlight4"},
+    {1, {{0x0000000000000080ULL, 0x0000000000000000ULL}}, "!flashlight"},
+    {1, {{0x0000000000000000ULL, 0x0000000000008080ULL}}, "scan"},
+    {1, {{0x0000000000008080ULL, 0x0000000000000000ULL}}, "!scan"},
+    {1, {{0x0000000000000000ULL, 0x0000000000808080ULL}}, "crazy"},
+    {1, {{0x0000000000808080ULL, 0x0000000000000000ULL}}, "!crazy"},
+    {1, {{0x0000000000000000ULL, 0x0000000080808080ULL}}, "counter1"},
+    {1, {{0x0000000000000040ULL, 0x0000000080808080ULL}}, "counter2"},
+    {1, {{0x0000000000000020ULL, 0x0000000080808080ULL}}, "counter3"},
+    {1, {{0x0000000000004000ULL, 0x0000000080808080ULL}}, "counter4"},
+    {1, {{0x0000000000002000ULL, 0x0000000080808080ULL}}, "counter5"},
+    {1, {{0x0000000000001000ULL, 0x0000000080808080ULL}}, "counter6"},
+    {1, {{0x0000000080808080ULL, 0x0000000000000000ULL}}, "!counter"},
+};
+
+typedef struct GestureEdge_t
+{
+  uint64_t pressed;
+  uint64_t longPressed;
+  uint16_t parentNode;
+
+  bool operator==(const GestureEdge_t &other) const
+  {
+    return pressed == other.pressed && longPressed == other.longPressed &&
+           parentNode == other.parentNode;
+  }
+} GestureEdge;
+
+struct GestureEdgeHash
+{
+  size_t operator()(const GestureEdge &edge) const
+  {
+    uint64_t hash = edge.pressed * 0x9e3779b97f4a7c15ULL;
+    hash ^= (edge.longPressed + edge.parentNode) * 0xc2b2ae3d27d4eb4fULL;
+    return (size_t)(hash ^ (hash >> 32));
+  }
+};
+
+typedef struct GestureNode_t
+{
+  int16_t gestureIndex; // gesture that ends in this node (-1 => none)
+  bool hasChildren;
+} GestureNode;
+
+static const uint16_t gestureRootNode = 0;
+
+typedef std::vector<Gesture> Gestures;
+static Gestures gestures;
+static std::vector<GestureNode> gestureNodes;
+static std::unordered_map<GestureEdge, uint16_t, GestureEdgeHash> gestureEdges;
+
+static uint16_t currGestureNode = gestureRootNode;
+static uint32_t lastGestureStepMillis = 0;
+
+// Only holds the gestures while they are being saved or loaded
+static std::vector<uint8_t> gesturesBlob;
+static NvWear gesturesWear = {ATTR_GESTURES};
+
+// FWD
+static void gestures1minTick();
+
+static void compileGestures()
+{
+  gestureNodes.clear();
+  gestureEdges.clear();
+  gestureNodes.push_back({-1, false}); // root
+  currGestureNode = gestureRootNode;
+
+  for (size_t i = 0; i < gestures.size(); ++i)
+  {
+    const Gesture &gesture = gestures[i];
+    uint16_t node = gestureRootNode;
+    for (uint8_t step = 0; step < gesture.stepsCount; ++step)
+    {
+      const GestureEdge edge = {gesture.steps[step].pressed, gesture.steps[step].longPressed, node};
+      auto iter = gestureEdges.find(edge);
+      if (iter == gestureEdges.end())
+      {
+        gestureNodes[node].hasChildren = true;
+        gestureNodes.push_back({-1, false});
+        iter = gestureEdges.insert(std::make_pair(edge, (uint16_t)(gestureNodes.size() - 1))).first;
+      }
+      node = (*iter).second;
+    }
+    gestureNodes[node].gestureIndex = (int16_t)i;
+  }
+
+#ifdef DEBUG
+  Serial.printf("Compiled %zu gestures into %zu trie nodes\n", gestures.size(), gestureNodes.size());
+#endif
+}
+
+static void loadDefaultGestures()
+{
+  gestures.assign(defaultGestures, defaultGestures + sizeof(defaultGestures) / sizeof(defaultGestures[0]));
+}
+
+static inline void gesturesPutBytes(const void *bytes, size_t bytesSize)
+{
+  const uint8_t *const first = static_cast<const uint8_t *>(bytes);
+  gesturesBlob.insert(gesturesBlob.end(), first, first + bytesSize);
+}
+
+template <typename T>
+static inline void gesturesPut(const T &value)
+{
+  gesturesPutBytes(&value, sizeof(value));
+}
+
+// Note: reading past the end leaves offset past it too, so the blob can be checked once it is read
+static inline void gesturesGetBytes(size_t &offset, void *bytes, size_t bytesSize)
+{
+  if (offset + bytesSize > gesturesBlob.size())
+  {
+    memset(bytes, 0, bytesSize);
+    offset = gesturesBlob.size() + 1;
+    return;
+  }
+  memcpy(bytes, &gesturesBlob[offset], bytesSize);
+  offset += bytesSize;
+}
+
+template <typename T>
+static inline void gesturesGet(size_t &offset, T &value)
+{
+  gesturesGetBytes(offset, &value, sizeof(value));
+}
+
+static void gesturesBlobRelease()
+{
+  std::vector<uint8_t>().swap(gesturesBlob);
+}
+
+// Field by field, and only the steps and action bytes each gesture uses
+static size_t gesturesSerialize()
+{
+  gesturesBlob.clear();
+  gesturesPut(gesturesMagic);
+  gesturesPut(gesturesVersion);
+  gesturesPut((uint8_t)gestures.size());
+  for (const Gesture &gesture : gestures)
+  {
+    gesturesPut(gesture.stepsCount);
+    for (uint8_t step = 0; step < gesture.stepsCount; ++step)
+    {
+      gesturesPut(gesture.steps[step].pressed);
+      gesturesPut(gesture.steps[step].longPressed);
+    }
+    const uint8_t actionSize = (uint8_t)strnlen(gesture.action, gestureActionSize - 1);
+    gesturesPut(actionSize);
+    gesturesPutBytes(gesture.action, actionSize);
+  }
+  return gesturesBlob.size();
+}
+
+static bool gesturesGetOne(size_t &offset, Gesture &gesture)
+{
+  gesture = Gesture();
+  gesturesGet(offset, gesture.stepsCount);
+  if (gesture.stepsCount == 0 || gesture.stepsCount > gestureMaxSteps)
+    return false;
+  for (uint8_t step = 0; step < gesture.stepsCount; ++step)
+  {
+    gesturesGet(offset, gesture.steps[step].pressed);
+    gesturesGet(offset, gesture.steps[step].longPressed);
+  }
+  uint8_t actionSize = 0;
+  gesturesGet(offset, actionSize);
+  if (actionSize == 0 || actionSize >= gestureActionSize)
+    return false;
+  gesturesGetBytes(offset, gesture.action, actionSize);
+  return offset <= gesturesBlob.size();
+}
+
+// Note: all or nothing, so a bad blob leaves the gestures alone
+static bool gesturesDeserialize()
+{
+  size_t offset = 0;
+  uint16_t magic = 0;
+  uint8_t version = 0;
+  uint8_t gesturesSize = 0;
+  gesturesGet(offset, magic);
+  gesturesGet(offset, version);
+  gesturesGet(offset, gesturesSize);
+  bool isValid = offset == gesturesHeaderSize && magic == gesturesMagic && version == gesturesVersion &&
+                 gesturesSize <= gesturesMaxSize;
+
+  Gestures loaded(isValid ? gesturesSize : 0);
+  for (size_t i = 0; isValid && i < loaded.size(); ++i)
+    isValid = gesturesGetOne(offset, loaded[i]);
+  if (!isValid || offset != gesturesBlob.size())
+  {
+#ifdef DEBUG
+    Serial.printf("Ignoring saved gestures with unexpected format\n");
+#endif
+    return false;
+  }
+  gestures.swap(loaded);
+  return true;
+}
+
+static void gesturesSaveRequest()
+{
+  if (!nvWearSaveIsDue(gesturesWear))
+    return;
+  const size_t blobSize = gesturesSerialize();
+  nvWearPutBytes(gesturesWear, gesturesBlob.data(), blobSize);
+  gesturesBlobRelease();
+}
+
+static bool loadSavedGestures()
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, true /*readOnly*/);
+  const size_t blobSize = preferences.getBytesLength(ATTR_GESTURES);
+  const size_t blobMaxSize = gesturesHeaderSize + gesturesMaxSize * gestureMaxBlobSize;
+  if (blobSize != 0 && blobSize <= blobMaxSize)
+  {
+    gesturesBlob.resize(blobSize);
+    if (preferences.getBytes(ATTR_GESTURES, gesturesBlob.data(), blobSize) != blobSize)
+      gesturesBlob.clear();
+  }
+  preferences.end();
+
+  // Remember what is in nvs, so unchanged gestures are never rewritten
+  gesturesWear.savedHash = gesturesBlob.empty() ? 0 : nvWearHash(gesturesBlob.data(), gesturesBlob.size());
+  const bool result = !gesturesBlob.empty() && gesturesDeserialize();
+  gesturesBlobRelease();
+  return result;
+}
+
+static bool sameSteps(const Gesture &left, const Gesture &right)
+{
+  if (left.stepsCount != right.stepsCount)
+    return false;
+  for (uint8_t step = 0; step < left.stepsCount; ++step)
+  {
+    if (left.steps[step].pressed != right.steps[step].pressed ||
+        left.steps[step].longPressed != right.steps[step].longPressed)
+      return false;
+  }
+  return true;
+}
+
+bool gestureSet(const Gesture &newGesture)
+{
+  if (newGesture.stepsCount == 0 || newGesture.stepsCount > gestureMaxSteps)
+    return false;
+  Gesture gesture = newGesture;
+  gesture.action[gestureActionSize - 1] = 0;
+
+  Gestures::iterator iter = gestures.begin();
+  while (iter != gestures.end() && !sameSteps(*iter, gesture))
+    ++iter;
+
+  if (gesture.action[0] == 0)
+  {
+    if (iter == gestures.end())
+      return false; // noop
+    gestures.erase(iter);
+  }
+  else if (iter != gestures.end())
+  {
+    if (strncmp((*iter).action, gesture.action, gestureActionSize) == 0)
+      return true; // noop
+    *iter = gesture;
+  }
+  else
+  {
+    if (gestures.size() >= gesturesMaxSize)
+      return false;
+    gestures.push_back(gesture);
+  }
+
+  compileGestures();
+  gesturesSaveRequest();
+  return true;
+}
+
+void gesturesReset()
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  preferences.remove(ATTR_GESTURES);
+  preferences.end();
+  gesturesWear.savedHash = 0;
+  gesturesWear.saveIsPending = false;
+
+  loadDefaultGestures();
+  compileGestures();
+}
+
+void initGestures(TickerScheduler &ts)
+{
+  if (!loadSavedGestures())
+    loadDefaultGestures();
+  compileGestures();
+
+  // Init tickers
+  const uint32_t oneSec = 1000;
+  const uint32_t oneMin = oneSec * 60;
+
+  ts.sched(gestures1minTick, oneMin);
+}
+
+static void gestures1minTick()
+{
+  if (gesturesWear.saveIsPending)
+    gesturesSaveRequest();
+}
+
+void gestureRunAction(const char *gestureAction)
+{
+  // Note: copy it, since the action itself may change the gestures
+  char action[gestureActionSize];
+  strncpy(action, gestureAction, sizeof(action));
+  action[gestureActionSize - 1] = 0;
+#ifdef DEBUG
+  Serial.printf("Gesture action: %s\n", action);
+#endif
+  // Local actions are not reachable as mqtt cmd ops
+  if (strcmp(action, "nvClear") == 0)
+    nvClearRequest();
+  else
+    runCmdOp(action);
+}
+
+void localButtonProcess(uint64_t pressed, uint64_t longPressed)
+{
+  const uint32_t now = millis();
+  if (currGestureNode != gestureRootNode && now - lastGestureStepMillis > gestureStepTimeoutMs)
+    currGestureNode = gestureRootNode;
+
+  auto iter = gestureEdges.find({pressed, longPressed, currGestureNode});
+  if (iter == gestureEdges.end() && currGestureNode != gestureRootNode)
+    iter = gestureEdges.find({pressed, longPressed, gestureRootNode}); // start over
+  if (iter == gestureEdges.end())
+  {
+    currGestureNode = gestureRootNode;
+    return;
+  }
+
+  const GestureNode &node = gestureNodes[(*iter).second];
+  lastGestureStepMillis = now;
+  currGestureNode = node.hasChildren ? (*iter).second : gestureRootNode;
+  if (node.gestureIndex >= 0)
+    gestureRunAction(gestures[node.gestureIndex].action);
+}
@@ -0,0 +1,40 @@
+#ifndef _GESTURES_H
+
+#define _GESTURES_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+class TickerScheduler;
+
+static const size_t gestureMaxSteps = 4;
+static const size_t gestureActionSize = 16; // including null terminator
+
+// short and long press combo of a single button event report
+typedef struct GestureChord_t
+{
+  uint64_t pressed;
+  uint64_t longPressed;
+} GestureChord;
+
+// ordered chords that trigger the action: either a cmd op name or a local action
+typedef struct Gesture_t
+{
+  uint8_t stepsCount;
+  GestureChord steps[gestureMaxSteps];
+  char action[gestureActionSize];
+} Gesture;
+
+void initGestures(TickerScheduler &ts); // saved gestures, or the default ones
+void localButtonProcess(uint64_t pressed, uint64_t longPressed);
+bool gestureSet(const Gesture &gesture); // empty action removes gesture
+void gesturesReset();
+void gestureRunAction(const char *action); // cmd op or local action
+
+// swipes and drags across adjacent keys
+void initSwipes();
+void swipeKeyEdge(int buttonIndex, bool pressed, uint32_t eventMillis);
+void swipesFastTick(); // finishes trails that went idle
+bool swipeActionSet(const char *triggerName, const char *action); // empty action removes it
+
+#endif // _GESTURES_H
@@ -0,0 +1,40 @@
+#include "hsv.h"
+
+// Fixed point, with no branches on the sector: each sector of the wheel is just a different
+// pick of the same 4 levels (value, falling, rising and the floor set by saturation).
+
+typedef enum HsvLevel_t
+{
+  hsvLevelValue,
+  hsvLevelFalling,
+  hsvLevelRising,
+  hsvLevelFloor,
+} HsvLevel;
+
+// red, green and blue levels of each of the 6 sectors
+static const uint8_t hsvSectorLevels[6][3] = {
+    {hsvLevelValue, hsvLevelRising, hsvLevelFloor},   // red to yellow
+    {hsvLevelFalling, hsvLevelValue, hsvLevelFloor},  // yellow to green
+    {hsvLevelFloor, hsvLevelValue, hsvLevelRising},   // green to cyan
+    {hsvLevelFloor, hsvLevelFalling, hsvLevelValue},  // cyan to blue
+    {hsvLevelRising, hsvLevelFloor, hsvLevelValue},   // blue to magenta
+    {hsvLevelValue, hsvLevelFloor, hsvLevelFalling},  // magenta to red
+};
+
+uint32_t hsvToRgb(uint16_t hue, uint8_t saturation, uint8_t value)
+{
+  const uint32_t scaled = (uint32_t)hue * 6;
+  const uint32_t sector = scaled >> 16;                // 0..5
+  const uint32_t fraction = (scaled >> 8) & 0xff;      // position within sector, Q8
+  const uint32_t sat = saturation + (saturation >> 7); // 0..256, so 255 is fully saturated
+  const uint32_t v = value;
+
+  uint32_t levels[4];
+  levels[hsvLevelValue] = v;
+  levels[hsvLevelFloor] = (v * (256 - sat)) >> 8;
+  levels[hsvLevelFalling] = (v * (65536 - sat * fraction)) >> 16;
+  levels[hsvLevelRising] = (v * (65536 - sat * (256 - fraction))) >> 16;
+
+  const uint8_t *const pick = hsvSectorLevels[sector];
+  return (levels[pick[0]] << 16) | (levels[pick[1]] << 8) | levels[pick[2]];
+}
@@ -0,0 +1,11 @@
+#ifndef _HSV_H
+
+#define _HSV_H
+
+#include <inttypes.h>
+
+// Hues go around the color wheel as a uint16_t: 0 => red, 0x5555 => green, 0xaaaa => blue,
+// and back to red as it wraps. Saturation and value are 0..255.
+uint32_t hsvToRgb(uint16_t hue, uint8_t saturation, uint8_t value = 255);
+
+#endif // _HSV_H
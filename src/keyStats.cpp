@@ -0,0 +1,123 @@
+#include "common.h"
+#include "keyStats.h"
+#include "wifiConfig.h"
+#include "tickerScheduler.h"
+
+#include <Preferences.h>
+
+// Counters are bumped in RAM by the button path and written to nvs at most once an
+// hour, and only when they changed. A reboot loses up to an hour of counts, but the
+// flash does not get a write per button press.
+
+static const char *const ATTR_KEY_STATS = "keyStats";
+static const uint16_t keyStatsMagic = 0x4b53; // "KS"
+static const uint8_t keyStatsVersion = 1;
+
+typedef struct
+{
+  uint16_t magic;
+  uint8_t version;
+  KeyUsage keys[Y_DIM * X_DIM];
+} KeyStatsBlob;
+
+static KeyStatsBlob keyStats;
+static uint16_t holdMsRemainder[Y_DIM * X_DIM]; // not yet accounted in holdSecs
+static bool keyStatsDirty = false;
+
+// FWD
+static void keyStats1hourTick();
+
+static void keyStatsClear()
+{
+  memset(&keyStats, 0, sizeof(keyStats));
+  memset(holdMsRemainder, 0, sizeof(holdMsRemainder));
+  keyStats.magic = keyStatsMagic;
+  keyStats.version = keyStatsVersion;
+}
+
+static inline void _bumpCounter(uint32_t &counter, uint32_t incr = 1)
+{
+  counter = (counter > 0xffffffffUL - incr) ? 0xffffffffUL : counter + incr;
+}
+
+void keyStatsAdd(int buttonIndex, ButtonKeyEvent keyEvent, uint32_t heldMs)
+{
+  if (buttonIndex < 0 || buttonIndex >= Y_DIM * X_DIM)
+    return;
+
+  KeyUsage &usage = keyStats.keys[buttonIndex];
+  switch (keyEvent)
+  {
+  case buttonKeyEventRelease:
+    _bumpCounter(usage.presses);
+    if (heldMs >= state.longPressMs)
+      _bumpCounter(usage.longPresses);
+    break;
+  case buttonKeyEventStuck:
+    _bumpCounter(usage.stuck);
+    break;
+  default:
+    return;
+  }
+
+  const uint32_t holdMs = heldMs + holdMsRemainder[buttonIndex];
+  _bumpCounter(usage.holdSecs, holdMs / 1000);
+  holdMsRemainder[buttonIndex] = (uint16_t)(holdMs % 1000);
+  keyStatsDirty = true;
+}
+
+const KeyUsage &keyStatsGet(int buttonIndex)
+{
+  return keyStats.keys[buttonIndex];
+}
+
+void keyStatsFlush()
+{
+  if (!keyStatsDirty)
+    return;
+
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  const size_t written = preferences.putBytes(ATTR_KEY_STATS, &keyStats, sizeof(keyStats));
+  preferences.end();
+  if (written == sizeof(keyStats))
+    keyStatsDirty = false;
+
+#ifdef DEBUG
+  Serial.printf("Key stats flushed %zu of %zu bytes\n", written, sizeof(keyStats));
+#endif
+}
+
+void keyStatsReset()
+{
+  keyStatsClear();
+  keyStatsDirty = false;
+
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  preferences.remove(ATTR_KEY_STATS);
+  preferences.end();
+}
+
+void initKeyStats(TickerScheduler &ts)
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, true /*readOnly*/);
+  const bool loaded = preferences.getBytesLength(ATTR_KEY_STATS) == sizeof(keyStats) &&
+                      preferences.getBytes(ATTR_KEY_STATS, &keyStats, sizeof(keyStats)) == sizeof(keyStats);
+  preferences.end();
+
+  if (!loaded || keyStats.magic != keyStatsMagic || keyStats.version != keyStatsVersion)
+    keyStatsClear();
+
+  // Init tickers
+  const uint32_t oneSec = 1000;
+  const uint32_t oneHour = oneSec * 60 * 60;
+
+  ts.sched(keyStats1hourTick, oneHour);
+}
+
+static void keyStats1hourTick()
+{
+  keyStatsFlush();
+}
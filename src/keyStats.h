@@ -0,0 +1,26 @@
+#ifndef _KEY_STATS_H
+
+#define _KEY_STATS_H
+
+#include "buttons.h"
+
+#include <inttypes.h>
+
+class TickerScheduler;
+
+// Usage counters of a button, kept across reboots to spot keys that wear out or get stuck
+typedef struct KeyUsage_t
+{
+  uint32_t presses;     // every release, regardless of how long it was held
+  uint32_t longPresses; // released after longPressMs
+  uint32_t stuck;       // held for longer than maxPressMs
+  uint32_t holdSecs;    // cumulative time held down
+} KeyUsage;
+
+void initKeyStats(TickerScheduler &ts);
+void keyStatsAdd(int buttonIndex, ButtonKeyEvent keyEvent, uint32_t heldMs);
+const KeyUsage &keyStatsGet(int buttonIndex);
+void keyStatsFlush(); // write to nvs now, if anything changed
+void keyStatsReset();
+
+#endif // _KEY_STATS_H
@@ -1,15 +1,109 @@
 #include "lightUnit.h"
 #include "common.h"
+#include "prng.h"
+#include "tween.h"
 
 #include <Arduino.h>
 #include <map>
+#include <stddef.h>
 
-typedef std::map<int, LightUnit> LightUnits;
+// Each layer keeps its units in a list, from the top (lowest id) down. Drawing walks the lists,
+// instead of looking every unit up in the map
+typedef struct LightUnitNode_t
+{
+  LightUnit unit; // Note: must be first, so a LightUnit pointer is also its node
+  uint8_t layer;  // list it is in
+  struct LightUnitNode_t *above;
+  struct LightUnitNode_t *below;
+} LightUnitNode;
+static_assert(offsetof(LightUnitNode, unit) == 0, "unit must be the first member of LightUnitNode");
+
+typedef std::map<int, LightUnitNode> LightUnits;
 static LightUnits lightUnits;
+static LightUnitNode *layerTops[lightUnitLayers] = {nullptr};
+static LightUnitNode *layerBottoms[lightUnitLayers] = {nullptr};
+
+// Members of each group, so group ops do not have to look at every unit
+typedef std::multimap<LightUnitGroup, LightUnitId> LightUnitGroups;
+static LightUnitGroups lightUnitGroups;
 
 static const LightUnit lightUnitNull = {0};
 static const LightUnitState &lightUnitStateNull = lightUnitNull.state;
 
+static void addToGroup(LightUnitGroup group, LightUnitId id)
+{
+  if (group)
+    lightUnitGroups.insert(std::make_pair(group, id));
+}
+
+static void rmFromGroup(LightUnitGroup group, LightUnitId id)
+{
+  auto range = lightUnitGroups.equal_range(group);
+  for (auto iter = range.first; iter != range.second; ++iter)
+  {
+    if ((*iter).second == id)
+    {
+      lightUnitGroups.erase(iter);
+      return;
+    }
+  }
+}
+
+static inline LightUnitNode &nodeOf(const LightUnit *unitPtr)
+{
+  return *reinterpret_cast<LightUnitNode *>(const_cast<LightUnit *>(unitPtr));
+}
+
+static void linkNode(LightUnitNode &node, uint8_t layer)
+{
+  LightUnitNode *below = layerTops[layer];
+  while (below != nullptr && below->unit.id < node.unit.id)
+    below = below->below;
+
+  node.layer = layer;
+  node.below = below;
+  node.above = below ? below->above : layerBottoms[layer];
+  if (node.above)
+    node.above->below = &node;
+  else
+    layerTops[layer] = &node;
+  if (below)
+    below->above = &node;
+  else
+    layerBottoms[layer] = &node;
+}
+
+static void unlinkNode(LightUnitNode &node)
+{
+  if (node.above)
+    node.above->below = node.below;
+  else
+    layerTops[node.layer] = node.below;
+  if (node.below)
+    node.below->above = node.above;
+  else
+    layerBottoms[node.layer] = node.above;
+  node.above = node.below = nullptr;
+}
+
+// bottom unit of the first layer, from this one up, that has units
+static LightUnit *bottomFromLayer(int layer)
+{
+  for (; layer < (int)lightUnitLayers; ++layer)
+    if (layerBottoms[layer])
+      return &layerBottoms[layer]->unit;
+  return nullptr;
+}
+
+// top unit of the first layer, from this one down, that has units
+static LightUnit *topFromLayer(int layer)
+{
+  for (; layer >= 0; --layer)
+    if (layerTops[layer])
+      return &layerTops[layer]->unit;
+  return nullptr;
+}
+
 int /*LightUnitId*/ addLightUnit(const LightUnit &lightUnit)
 {
   static const int maxAttempts = 1024;
@@ -43,8 +137,16 @@ void setLightUnit(int /*LightUnitId*/ id, const LightUnit &lightUnit,
   else if (exists)
     lightUnitFinalIteration(&newLightUnit);
 
+  // Note: look it up again, since the doneCallback run by rmLightUnit may have set this id
+  //       (flashlight hands over to crazy that way). That unit is linked and grouped already
+  LightUnits::iterator iter(lightUnits.find(id));
+  const bool isIndexed = iter != lightUnits.end();
+  const LightUnitGroup prevGroup = isIndexed ? (*iter).second.unit.group : 0;
+
   newLightUnit = lightUnit;
   newLightUnit.id = id;
+  if (newLightUnit.layer >= lightUnitLayers)
+    newLightUnit.layer = lightUnitLayers - 1;
   if (newLightUnit.animation.rainbowColor ||
       newLightUnit.animation.randomColor ||
       newLightUnit.animation.sameRandomColor)
@@ -57,9 +159,28 @@ void setLightUnit(int /*LightUnitId*/ id, const LightUnit &lightUnit,
   {
     newLightUnit.animation.speed = 1;
   }
+  if (newLightUnit.animation.tweenMs > tweenMaxMs)
+    newLightUnit.animation.tweenMs = tweenMaxMs;
   newLightUnit.state = lightUnitStateNull;
+  newLightUnit.state.tweenStartMs = lightsClockMs();
+  newLightUnit.state.pausedMs = newLightUnit.state.tweenStartMs;
+  newLightUnit.state.hue = newLightUnit.animation.hue;
+  newLightUnit.state.rng = prngSeed(newLightUnit.seed ? newLightUnit.seed : (uint32_t)id);
 
-  lightUnits[id] = newLightUnit;
+  LightUnitNode &node = isIndexed ? (*iter).second : lightUnits[id];
+  node.unit = newLightUnit;
+  if (!isIndexed || node.layer != newLightUnit.layer)
+  {
+    if (isIndexed)
+      unlinkNode(node);
+    linkNode(node, newLightUnit.layer);
+  }
+  if (!isIndexed || prevGroup != newLightUnit.group)
+  {
+    if (isIndexed)
+      rmFromGroup(prevGroup, id);
+    addToGroup(newLightUnit.group, id);
+  }
 
   if (!quiet || !exists)
   {
@@ -78,8 +199,10 @@ void rmLightUnit(int /*LightUnitId*/ id)
     return; // noop
 
   // First: get a local copy and remove it from lightUnits
-  LightUnit lightUnit((*iter).second);
+  LightUnit lightUnit((*iter).second.unit);
+  unlinkNode((*iter).second);
   lightUnits.erase(iter);
+  rmFromGroup(lightUnit.group, id);
 
   lightUnitFinalIteration(&lightUnit);
   if (lightUnit.doneCallback)
@@ -110,39 +233,105 @@ void rmLightUnits()
   // lightUnits.clear();  // cannot use it bc we want to check done callback
 }
 
+void pauseLightUnit(LightUnitId id, bool paused)
+{
+  LightUnit *unitPtr = getLightUnit(id);
+  if (unitPtr == nullptr || unitPtr->paused == paused)
+    return; // noop
+
+  LightUnitState &unitState = unitPtr->state;
+  const uint32_t now = lightsClockMs();
+  if (paused)
+    unitState.pausedMs = now;
+  else
+    unitState.tweenStartMs += now - unitState.pausedMs;
+  unitPtr->paused = paused;
+}
+
+std::vector<LightUnitId> getLightUnitGroup(LightUnitGroup group)
+{
+  std::vector<LightUnitId> ids;
+  auto range = lightUnitGroups.equal_range(group);
+  for (auto iter = range.first; iter != range.second; ++iter)
+    ids.push_back((*iter).second);
+  return ids;
+}
+
+void rmLightUnitGroup(LightUnitGroup group)
+{
+  // Note: removing a unit may remove others, via dependsOn
+  for (LightUnitId id : getLightUnitGroup(group))
+    rmLightUnit(id);
+}
+
+void pauseLightUnitGroup(LightUnitGroup group, bool paused)
+{
+  auto range = lightUnitGroups.equal_range(group);
+  for (auto iter = range.first; iter != range.second; ++iter)
+    pauseLightUnit((*iter).second, paused);
+}
+
 bool lightUnitExists(int /*LightUnitId*/ id, LightUnit *lightUnitPtr)
 {
   LightUnits::const_iterator iter(lightUnits.find((LightUnitId)id));
   const bool result = iter != lightUnits.end();
   if (lightUnitPtr)
-    *lightUnitPtr = result ? (*iter).second : lightUnitNull;
+    *lightUnitPtr = result ? (*iter).second.unit : lightUnitNull;
   return result;
 }
 
+LightUnit * getLightUnit(LightUnitId id)
+{
+  LightUnits::iterator iter(lightUnits.find(id));
+  return (iter == lightUnits.end()) ? nullptr : &(*iter).second.unit;
+}
+
 LightUnit * getFirstLightUnit()
 {
-  // Note: iterate backwards to give priority to ids explicitly used
-  auto iter(lightUnits.rbegin());
-  return (iter == lightUnits.rend()) ? nullptr : &(*iter).second;
+  // Note: bottom layer first and, within a layer, highest id first. That gives
+  //       priority to ids explicitly used
+  return bottomFromLayer(0);
 }
 
 void resetLightUnitAge(LightUnitId id)
 {
   LightUnits::iterator iter(lightUnits.find((LightUnitId)id));
   if (iter != lightUnits.end()) {
-    (*iter).second.state.age = 0;
+    (*iter).second.unit.state.age = 0;
   }
 }
 
-LightUnit * getNextLightUnit(LightUnitId id)
+LightUnit * getNextLightUnit(LightUnitId id, uint8_t layer)
 {
-  // Note: iterate backwards to give priority to ids explicitly used
-  // https://stackoverflow.com/questions/23011463/how-to-find-the-first-value-less-than-the-search-key-with-stl-set
-  auto iter(lightUnits.lower_bound(id));
-  if (iter == lightUnits.begin() || iter == lightUnits.end())
+  LightUnits::iterator iter(lightUnits.find(id));
+  if (iter != lightUnits.end() && (*iter).second.layer == layer)
+    return getLightUnitAbove(&(*iter).second.unit);
+
+  // Unit is gone: pick up in its layer, from the first unit that would be drawn after it
+  if (layer >= lightUnitLayers)
     return nullptr;
-  iter--;
-  return &(*iter).second;
+  LightUnitNode *above = layerBottoms[layer];
+  while (above != nullptr && above->unit.id >= id)
+    above = above->above;
+  return above ? &above->unit : bottomFromLayer(layer + 1);
+}
+
+LightUnit * getLightUnitAbove(const LightUnit *unitPtr)
+{
+  const LightUnitNode &node = nodeOf(unitPtr);
+  return node.above ? &node.above->unit : bottomFromLayer(node.layer + 1);
+}
+
+LightUnit * getTopLightUnit()
+{
+  // Note: lowest id of the top layer is drawn last, so it is the one on top
+  return topFromLayer(lightUnitLayers - 1);
+}
+
+LightUnit * getLightUnitBelow(const LightUnit *unitPtr)
+{
+  const LightUnitNode &node = nodeOf(unitPtr);
+  return node.below ? &node.below->unit : topFromLayer(node.layer - 1);
 }
 
 uint32_t lightUnitsSize() { return (uint32_t)lightUnits.size(); }
@@ -155,10 +344,16 @@ bool equivalentLightUnits(const LightUnit &left, const LightUnit &right)
     return false;
   if (left.color != right.color)
     return false;
+  if (left.blend != right.blend || left.alpha != right.alpha || left.seed != right.seed)
+    return false;
+  if (left.group != right.group || left.paused != right.paused || left.layer != right.layer)
+    return false;
   if (left.brightness != right.brightness)
     return false;
   if (memcmp(&left.animation, &right.animation, sizeof(left.animation)))
     return false;
+  if (left.kind != right.kind || memcmp(&left.payload, &right.payload, sizeof(left.payload)))
+    return false;
   if (left.iterateCallback != right.iterateCallback)
     return false;
   if (left.doneCallback != right.doneCallback)
@@ -176,6 +371,10 @@ void dumpLightUnit(const LightUnit &lightUnit, const char *msg)
   Serial.printf("  pixelMask: %s\n", buff);
   Serial.printf("  color: %d\n", lightUnit.color);
   Serial.printf("  brightness: %d\n", (int)lightUnit.brightness);
+  Serial.printf("  blend: %d alpha: %d\n", (int)lightUnit.blend, (int)lightUnit.alpha);
+  Serial.printf("  seed: %" PRIu32 "\n", lightUnit.seed);
+  Serial.printf("  layer: %d group: %u paused: %d\n", (int)lightUnit.layer, lightUnit.group,
+                (int)lightUnit.paused);
   Serial.printf("  iterateCallback: %p\n", lightUnit.iterateCallback);
   Serial.printf("  doneCallback: %p\n", lightUnit.doneCallback);
 
@@ -193,6 +392,34 @@ void dumpLightUnit(const LightUnit &lightUnit, const char *msg)
                 (int)lightUnit.animation.keepPixelWhenDone,
                 (int)lightUnit.animation.blink,
                 (int)lightUnit.animation.pulse);
+  Serial.printf("  anim.tween: color %d ms %d easing %d loop %d\n",
+                lightUnit.animation.tweenColor, lightUnit.animation.tweenMs,
+                (int)lightUnit.animation.tweenEasing, (int)lightUnit.animation.tweenLoop);
+  Serial.printf("  anim.transform: %d speed %d\n",
+                (int)lightUnit.animation.transform, lightUnit.animation.transformSpeed);
+  Serial.printf("  anim.hsv: %d hue %u speed %d spread %d saturation %d\n",
+                (int)lightUnit.animation.hsvColor, lightUnit.animation.hue,
+                (int)lightUnit.animation.hueSpeed, (int)lightUnit.animation.hueSpread,
+                (int)lightUnit.animation.saturation);
+  Serial.printf("  anim.period: %" PRIu32 " ms phase %u\n",
+                lightUnit.animation.periodMs, lightUnit.animation.phase);
+  Serial.printf("  kind: %d\n", (int)lightUnit.kind);
+  if (lightUnit.kind == lightUnitKindText)
+    Serial.printf("  text: %.*s\n", (int)lightUnitTextSize, lightUnit.payload.text);
+  else if (lightUnit.kind == lightUnitKindAutomaton)
+    Serial.printf("  automaton: birth 0x%x survive 0x%x wrap %d generation %" PRIu32 "\n",
+                  lightUnit.payload.automaton.birth, lightUnit.payload.automaton.survive,
+                  (int)lightUnit.payload.automaton.wrap, lightUnit.state.kindStep);
+  else if (lightUnit.kind == lightUnitKindIndexed)
+    Serial.printf("  indexed: cycle %d..%d every %d frames, step %" PRIu32 "\n",
+                  (int)lightUnit.payload.indexed.cycleFirst, (int)lightUnit.payload.indexed.cycleLast,
+                  (int)lightUnit.payload.indexed.cycleSteps, lightUnit.state.kindStep);
+  else if (lightUnit.kind == lightUnitKindTable)
+    Serial.printf("  table: %d rows%s, row %" PRIu64 "\n", (int)lightUnit.payload.table.count,
+                  lightUnit.payload.table.pingPong ? " back and forth" : "", lightUnit.state.kindVars[0]);
+  else if (lightUnit.kind == lightUnitKindProgram)
+    Serial.printf("  program: %d frame %" PRIu32 "\n", (int)lightUnit.payload.program,
+                  lightUnit.state.kindStep);
   // LightUnitState state;
 #endif // ifdef DEBUG
 }
@@ -2,6 +2,8 @@
 #define __TRELLIS_LIGHT_UNIT
 
 #include <inttypes.h>
+#include <stddef.h>
+#include <vector>
 
 struct LightUnit_t;
 typedef void(IterateCallback)(struct LightUnit_t &unit);
@@ -10,6 +12,39 @@ typedef void(DoneCallback)(const struct LightUnit_t &unit);
 typedef int LightUnitId;
 static const LightUnitId minDynamicId = 512;
 
+typedef uint16_t LightUnitGroup; // 0 => not in a group
+static const uint8_t lightUnitLayers = 4;
+
+typedef enum TweenEasing_t
+{
+  tweenEasingLinear,
+  tweenEasingIn,    // starts slow
+  tweenEasingOut,   // ends slow
+  tweenEasingInOut, // starts and ends slow
+} TweenEasing;
+
+typedef enum TweenLoop_t
+{
+  tweenLoopOnce,     // stays at tweenColor when done
+  tweenLoopRestart,  // jumps back to color and fades again
+  tweenLoopPingPong, // fades back and forth
+} TweenLoop;
+
+typedef enum PixelTransform_t
+{
+  pixelTransformNone,
+  pixelTransformScrollLeft, // rows and columns scrolls wrap around
+  pixelTransformScrollRight,
+  pixelTransformScrollUp,
+  pixelTransformScrollDown,
+  pixelTransformRotate90, // clockwise
+  pixelTransformRotate180,
+  pixelTransformRotate270,
+  pixelTransformFlipHorizontal,
+  pixelTransformFlipVertical,
+  pixelTransformTranspose,
+} PixelTransform;
+
 typedef struct LightUnitAnimation_t
 {
   uint32_t frames;        // total number of frames this is part of
@@ -20,21 +55,114 @@ typedef struct LightUnitAnimation_t
   bool randomPixels;      // pick a random pixelMask
   bool sameRandomColor;   // overriden by randomColor. Pick a random color for pixelMask
   bool randomColor;       // overriden by rainbowColor. Pick a random color for each pixel in mask
-  bool rainbowColor;      // pick rainbow color for pixelMask (or pixel, when used with randomColor)
+  bool rainbowColor;      // pick rainbow color for pixelMask (or pixel, when used with randomColor),
+                          // starting at hue and moving by hueSpeed (or a fixed step) on every frame
   bool keepPixelWhenDone; // upon expiration, leave pixelMask alone?
-  bool blink;             // set color to 0 on every other frame
+  bool blink;             // set color to 0 on the second half of periodMs (default: every other frame)
   bool pulse;             // overriden by rainbowColor, randomColor, sameRandomColor.
-                          // if true, will apply modify brightness to color
+                          // if true, will apply modify brightness to color, as a sine wave over periodMs
+  uint32_t tweenColor;    // overriden by rainbowColor, randomColor, sameRandomColor. Fades color into this
+  uint32_t tweenMs;       // how long each fade takes (0 => no tween)
+  uint8_t tweenEasing;    // TweenEasing
+  uint8_t tweenLoop;      // TweenLoop
+  uint8_t transform;      // PixelTransform applied to pixelMask on every transform step
+  uint32_t transformSpeed; // how many refreshes between transform steps (in 100 ms units)
+  bool hsvColor;          // overriden by rainbowColor, randomColor, sameRandomColor. Color comes from hue and
+                          // saturation, while brightness and pulse set its value
+  uint16_t hue;           // of hsvColor and rainbowColor. 0..65535 goes around the color wheel, starting at red
+  int16_t hueSpeed;       // added to hue on every frame
+  int16_t hueSpread;      // hsvColor: added to hue from one pixel to the next, for gradients
+  uint8_t saturation;     // hsvColor: 0 => white, 255 => full color
+  uint32_t periodMs;      // of pulse and blink, on the animation clock shared by all units (0 => default)
+  uint16_t phase;         // of pulse and blink. 0..65535 is one full period
 } LightUnitAnimation;
 
+// How a unit's colors combine with what is drawn below it
+typedef enum LightUnitBlend_t
+{
+  lightUnitBlendReplace,  // hides what is below
+  lightUnitBlendAdd,      // adds each channel, saturating at 255
+  lightUnitBlendMax,      // keeps the brightest of each channel
+  lightUnitBlendMultiply, // scales what is below, like a tinted filter
+  lightUnitBlendAlpha,    // mixes with what is below, according to alpha
+} LightUnitBlend;
+
+typedef enum LightUnitKind_t
+{
+  lightUnitKindPixels,    // draws pixelMask
+  lightUnitKindText,      // pixelMask is a window over scrolling text
+  lightUnitKindAutomaton, // pixelMask is a cellular automaton board, one generation per frame
+  lightUnitKindIndexed,   // each pixel has a palette index. pixelMask follows non zero indices
+  lightUnitKindProgram,   // uploaded program sets pixelMask and color on every frame
+  lightUnitKindTable,     // pixelMask and color come from a table, one row per frame
+} LightUnitKind;
+
+static const size_t lightUnitTextSize = 32; // including null terminator
+static const size_t lightUnitPaletteSize = 16;
+static const size_t lightUnitPaletteIndices = 64 / 2; // 4 bits per pixel
+static const size_t lightUnitTableSize = 8;
+
+typedef struct LightUnitAutomaton_t
+{
+  uint16_t birth;   // bit n set => dead cell with n live neighbors is born
+  uint16_t survive; // bit n set => live cell with n live neighbors stays alive
+  bool wrap;        // edges wrap around, instead of being dead cells
+} LightUnitAutomaton;
+
+typedef struct LightUnitIndexed_t
+{
+  uint8_t indices[lightUnitPaletteIndices]; // pixel i is the low (even i) or high (odd i) nibble of byte i / 2
+  uint32_t palette[lightUnitPaletteSize];
+  uint8_t cycleFirst; // palette entries cycleFirst..cycleLast rotate by one every cycleSteps frames,
+  uint8_t cycleLast;  // fading into each other in between (cycleFirst >= cycleLast => no cycling)
+  uint8_t cycleSteps;
+} LightUnitIndexed;
+
+typedef struct LightUnitTable_t
+{
+  uint64_t masks[lightUnitTableSize];
+  uint32_t colors[lightUnitTableSize]; // 0 => unit's color
+  uint8_t count;                       // rows in use
+  bool pingPong;                       // plays rows back and forth, instead of starting over
+} LightUnitTable;
+
+// What the unit draws, other than pixelMask. Member in use depends on the unit's kind
+typedef union LightUnitPayload_t
+{
+  char text[lightUnitTextSize]; // lightUnitKindText
+  LightUnitAutomaton automaton; // lightUnitKindAutomaton
+  LightUnitIndexed indexed;     // lightUnitKindIndexed
+  uint8_t program;              // lightUnitKindProgram: slot of its bytecode
+  LightUnitTable table;         // lightUnitKindTable
+} LightUnitPayload;
+
 typedef struct LightUnitState_t
 {
   bool iterated;            // has it been iterated?
-  bool pulseGoingUp;        // pulse helper
-  uint32_t pulseBrightness; // pulse helper
   uint64_t age;             // increases on every tick
-  uint64_t tempPixels;
-  uint64_t tempCounter; // helper used for blink and randomPixels
+  uint64_t rng;          // prng state, seeded from seed (or id) when the unit is set
+  uint16_t hue;          // hue of this frame, for hsvColor and rainbowColor
+  uint64_t tempCounter; // helper used for randomPixels
+  uint32_t tweenStartMs; // when the unit was set, so tweens are driven by time
+  uint32_t pausedMs;     // when the unit was paused, so its tween resumes where it stopped
+  uint32_t kindStep;     // progress of what the kind draws, like text column
+  union
+  {
+    uint64_t kindVars[4]; // scratch of what the kind draws, like previous generation or program variables
+    struct
+    {
+      uint32_t palette[lightUnitPaletteSize]; // lightUnitKindIndexed: colors of this frame, cycled and scaled
+      uint32_t paletteStep;                   // the kindStep
+      uint32_t paletteColor;                  // and the drawnColor they were worked out for
+    };
+  };
+  uint64_t drawnPixels;    // contribution to the composite frame: pixels,
+  uint32_t drawnColor;     // their color
+  uint32_t drawnSeed;      // and, for randomColor, the seed of each pixel's color (0 => none)
+  uint16_t drawnHue;       // and, for hsvColor gradients, the hue of pixel 0
+  bool recolor;            // drawnColor is stale: unit was hidden when drawn, so it left it to the compositor
+  uint64_t coveredPixels;  // occlusion helper: pixels that replace units above it hide
+  uint64_t composePixels;  // compositor helper: drawnPixels visible in the frame being blended
 } LightUnitState;
 
 typedef struct LightUnit_t
@@ -43,7 +171,15 @@ typedef struct LightUnit_t
   uint64_t pixelMask; // overriden by randomPixels
   uint32_t color;     // overriden by sameRandomColor
   int8_t brightness;  // overriden by pulse. Adjusts color (0->ignored, 1->dark full->255)
+  uint8_t blend;      // LightUnitBlend
+  uint8_t alpha;      // used by lightUnitBlendAlpha (0->opaque, 1->see through full->255)
+  uint32_t seed;      // of random pixels and colors (0 => use id), so they can be replayed
+  uint8_t layer;        // higher layers are drawn on top. Within a layer, lower ids are on top
+  LightUnitGroup group; // lets related units be removed, paused or changed together
+  bool paused;          // keeps its last frame, without animating or expiring
   LightUnitAnimation animation;
+  uint8_t kind;             // LightUnitKind
+  LightUnitPayload payload;
   LightUnitState state;
   IterateCallback *iterateCallback; // if set, called when we are about to iterate unit
   DoneCallback *doneCallback;       // if set, called when unit is removed
@@ -54,9 +190,17 @@ void setLightUnit(LightUnitId id, const LightUnit &lightUnit, bool rmBeforeAdd =
 void resetLightUnitAge(LightUnitId id);
 void rmLightUnit(LightUnitId id);
 void rmLightUnits();
+void pauseLightUnit(LightUnitId id, bool paused);
+std::vector<LightUnitId> getLightUnitGroup(LightUnitGroup group); // ids of its members
+void rmLightUnitGroup(LightUnitGroup group);
+void pauseLightUnitGroup(LightUnitGroup group, bool paused);
 bool lightUnitExists(LightUnitId id, LightUnit *lightUnitPtr = nullptr);
-LightUnit * getFirstLightUnit();
-LightUnit * getNextLightUnit(LightUnitId id);
+LightUnit * getLightUnit(LightUnitId id);
+LightUnit * getFirstLightUnit(); // back to front
+LightUnit * getNextLightUnit(LightUnitId id, uint8_t layer); // works even if unit was removed
+LightUnit * getLightUnitAbove(const LightUnit *unitPtr);     // like getNextLightUnit, for units still there
+LightUnit * getTopLightUnit();                               // like getFirstLightUnit, but front to back
+LightUnit * getLightUnitBelow(const LightUnit *unitPtr);     // like getLightUnitAbove, but front to back
 // uint32_t lightUnitsSize();  // moved to common.h
 bool equivalentLightUnits(const LightUnit &left, const LightUnit &right);
 void dumpLightUnit(const LightUnit &lightUnit, const char *msg = 0);
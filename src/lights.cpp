@@ -2,20 +2,61 @@
 #include "buttons.h"
 #include "common.h"
 #include "animations.h"
+#include "automaton.h"
+#include "bitboard.h"
+#include "gestures.h"
+#include "hsv.h"
+#include "palette.h"
+#include "prng.h"
+#include "vm.h"
+#include "text.h"
+#include "tween.h"
 #include "tickerScheduler.h"
 
 // FWD
 static void refreshLights();
 static void lightsFastTick();
+static void tweenFastTick();
+static void compositeAndShow();
 static void lights100msTick();
 static void lights1minTick();
 
 // Light Units handling -- statics
 static int pixelColorCacheVersion = 0;
 static uint32_t pixelColorCache[64] = {0};
-static uint32_t currRefreshTick = 0;
+static uint32_t currRefreshTick = 0; // animation ticks: only counts refreshes the clock moved on
+static const uint32_t refreshMs = 100;
+static uint32_t animationClockMs = 0; // clock at the last animation tick. Pulse and blink follow it
+
+// Animation clock: real time, minus time spent paused, scaled by clockScale
+static uint32_t clockBaseMs = 0;     // clock when it was last paused, resumed or scaled
+static uint32_t clockBaseMillis = 0; // and millis() at that time
+static uint32_t clockScale = 100;    // percent
+static bool clockPaused = false;
+static uint32_t fastTweenUnitsCount = 0; // as seen by last refreshLights
 static const uint32_t cacheDirtyBit = 1 << 31;
 
+// Units do not draw into the cache directly. They leave their contribution in their state and
+// mark the pixels it touched, so only those get blended again and pushed out.
+static uint64_t composeDirty = 0;
+static uint32_t composeFrame[64] = {0};
+
+// Work skipped because replace units above hid it: units that did not work out their color
+// and pixels that were not blended again. Counted for the current and the last minute
+static uint32_t occludedUnits = 0;
+static uint32_t occludedPixels = 0;
+static uint32_t occludedUnitsLastMin = 0;
+static uint32_t occludedPixelsLastMin = 0;
+
+#ifdef DEBUG
+// What refreshLights costs: working out the frame, then pushing it out with trellis.show()
+static uint32_t refreshCount = 0;
+static uint32_t refreshFrameUs = 0;
+static uint32_t refreshFrameMaxUs = 0;
+static uint32_t refreshShowUs = 0;
+static uint32_t refreshShowMaxUs = 0;
+#endif
+
 // Create a matrix of trellis panels, using addressed soldered in
 Adafruit_NeoTrellis t_array[Y_DIM / 4][X_DIM / 4] = {
     {Adafruit_NeoTrellis(0x30), Adafruit_NeoTrellis(0x31)},
@@ -44,6 +85,8 @@ static uint32_t Wheel(byte WheelPos)
   }
   return 0;
 }
+uint32_t lightsWheel(uint8_t wheelPos) { return Wheel(wheelPos); }
+
 static uint32_t Wheel()
 {
   static byte currRainbowShade = 0;
@@ -57,23 +100,30 @@ static void pressedButtonAnimation()
     return; // noop
 
   const uint32_t animationColor = Wheel();
+  const uint32_t now = millis();
   for (int i = 0; i < Y_DIM * X_DIM; ++i)
   {
     if (getFlag(state.buttons.pressed, i))
     {
-      const uint32_t &pressedCounter = state.buttons.buttonPressedCounter[i];
-      if (pressedCounter < minPressThreshold)
+      const uint32_t heldMs = buttonHeldMs(i, now);
+      if (getFlag(state.buttons.reactionFeedback, i))
+      {
+        continue; // reaction lit it up already
+      }
+      else if (heldMs < state.minPressMs)
       {
         trellis.setPixelColor(i, 0x10); // blue while not yet down long enough
       }
-      else if (pressedCounter < longPressThreshold)
+      else if (heldMs < state.longPressMs)
       {
         trellis.setPixelColor(i, animationColor);
       }
-      else if (pressedCounter < maxPressThreshold)
+      else if (heldMs < state.maxPressMs)
       {
         // 0xff == blue 0xff00 == green 0xff0000 == red
         trellis.setPixelColor(i, 0xff00ff);
+        pixelColorCache[i] |= cacheDirtyBit;
+        buttonKeyEvent(i, buttonKeyEventLongPress);
       }
       else
       {
@@ -91,6 +141,8 @@ static void pressedButtonAnimation()
         clearFlag(state.buttons.pendingLongPressEvent, i);
         setFlag(state.buttons.abortedPendingPressEvent, i);
         trellis.setPixelColor(i, 0xff0000);
+        pixelColorCache[i] |= cacheDirtyBit;
+        buttonKeyEvent(i, buttonKeyEventStuck);
       }
     }
   }
@@ -108,9 +160,14 @@ static uint64_t unpressedButtonUpdate()
         !getFlag(state.buttons.pressed, i) &&
         !getFlag(state.buttons.abortedPendingPressEvent, i))
     {
-      trellis.setPixelColor(i, 0);
-      pixelColorCache[i] |= cacheDirtyBit;
+      // Pixel of a button lit by a reaction is accurate, unless long press painted over it
+      if (!getFlag(state.buttons.reactionFeedback, i) || (pixelColorCache[i] & cacheDirtyBit))
+      {
+        trellis.setPixelColor(i, 0);
+        pixelColorCache[i] |= cacheDirtyBit;
+      }
       setFlag(unpressedMask, i);
+      buttonKeyEvent(i, buttonKeyEventRelease);
 
 #ifdef DEBUG
       static char buff[17];
@@ -118,9 +175,9 @@ static uint64_t unpressedButtonUpdate()
       snprintf(buff, sizeof(buff), "%02u", i + 1);
       Serial.print(buff);
       Serial.print(" released after ");
-      snprintf(buff, sizeof(buff), "%3u", state.buttons.buttonPressedCounter[i]);
+      snprintf(buff, sizeof(buff), "%5u", (unsigned)(state.buttons.releaseMillis[i] - state.buttons.pressMillis[i]));
       Serial.print(buff);
-      Serial.print(" x 100 ms");
+      Serial.print(" ms");
       Serial.println("");
 #endif
     }
@@ -162,7 +219,7 @@ void initTrellis(TickerScheduler &ts)
   const uint32_t oneMin = oneSec * 60;
 
   ts.sched(lightsFastTick, 20);
-  ts.sched(lights100msTick, 100);
+  ts.sched(lights100msTick, refreshMs);
   ts.sched(lights1minTick, oneMin);
 }
 
@@ -172,8 +229,11 @@ static void lightsFastTick()
 
   if (state.buttons.pressed || state.buttons.changedState)
   {
+    buttonPressEvents(state.buttons.changedState & state.buttons.pressed);
+
     pressedButtonAnimation();
     const uint64_t unpressedMask = unpressedButtonUpdate();
+    lightsRedrawPixels(unpressedMask);
     trellis.show();
 
     // Done processing changes
@@ -187,12 +247,13 @@ static void lightsFastTick()
 #endif
         for (int i = 0; i < Y_DIM * X_DIM; ++i)
         {
+          const uint32_t heldMs = state.buttons.releaseMillis[i] - state.buttons.pressMillis[i];
           if (getFlag(unpressedMask, i) &&
               !getFlag(state.buttons.abortedPendingPressEvent, i) &&
-              state.buttons.buttonPressedCounter[i] >= minPressThreshold)
+              heldMs >= state.minPressMs)
           {
             setFlag(state.buttons.pendingPressEvent, i);
-            if (state.buttons.buttonPressedCounter[i] >= longPressThreshold)
+            if (heldMs >= state.longPressMs)
             {
               setFlag(state.buttons.pendingLongPressEvent, i);
             }
@@ -208,15 +269,11 @@ static void lightsFastTick()
       }
 
       state.buttons.changedState = 0;
-
-      // If no buttons are pressed, reset the pressed counter on all
-      if (state.buttons.pressed == 0)
-      {
-        for (int i = 0; i < Y_DIM * X_DIM; ++i)
-          state.buttons.buttonPressedCounter[i] = 0;
-      }
     }
   }
+  swipesFastTick();
+  tweenFastTick();
+  compositeAndShow();
 }
 
 static void lights100msTick()
@@ -224,8 +281,61 @@ static void lights100msTick()
   refreshLights();
 }
 
+uint32_t lightsClockMs()
+{
+  if (clockPaused)
+    return clockBaseMs;
+  return clockBaseMs + (uint32_t)((uint64_t)(millis() - clockBaseMillis) * clockScale / 100);
+}
+
+static void rebaseClock()
+{
+  clockBaseMs = lightsClockMs();
+  clockBaseMillis = millis();
+}
+
+void lightsClockPause(bool paused)
+{
+  rebaseClock();
+  clockPaused = paused;
+#ifdef DEBUG
+  Serial.printf("Animation clock %s at %" PRIu32 " ms\n", paused ? "paused" : "resumed", clockBaseMs);
+#endif
+}
+
+void lightsClockScale(uint32_t timeScale)
+{
+  rebaseClock();
+  clockScale = timeScale < 1 ? 1 : (timeScale > 100 ? 100 : timeScale);
+}
+
+// Tells if the animation clock moved on by a refresh since the last tick. At most one tick per
+// refresh: when it falls behind, it skips ahead instead of catching up, so units stay in step
+static bool animationClockTick()
+{
+  const int32_t behindMs = (int32_t)(lightsClockMs() - animationClockMs);
+  if (behindMs < (int32_t)(refreshMs / 2))
+    return false; // allows a late refresh to still tick, when not scaled
+  animationClockMs += behindMs < (int32_t)(refreshMs * 2) ? refreshMs : (behindMs / refreshMs) * refreshMs;
+  return true;
+}
+
 static void lights1minTick()
 {
+#ifdef DEBUG
+  Serial.printf("Occlusion skipped %" PRIu32 " unit colors and %" PRIu32 " pixel blends in the last minute\n",
+                occludedUnits, occludedPixels);
+  if (refreshCount)
+    Serial.printf("refreshLights x %" PRIu32 ": frame avg %" PRIu32 " max %" PRIu32
+                  " us, show avg %" PRIu32 " max %" PRIu32 " us\n",
+                  refreshCount, refreshFrameUs / refreshCount, refreshFrameMaxUs,
+                  refreshShowUs / refreshCount, refreshShowMaxUs);
+  refreshCount = refreshFrameUs = refreshFrameMaxUs = refreshShowUs = refreshShowMaxUs = 0;
+#endif
+  occludedUnitsLastMin = occludedUnits;
+  occludedPixelsLastMin = occludedPixels;
+  occludedUnits = occludedPixels = 0;
+
   if (isBatteryLow())
     startAnimationLowBattery();
 }
@@ -238,32 +348,49 @@ void clearLights(bool callTrellisShow)
     trellis.show();
 }
 
+void showLights()
+{
+  trellis.show();
+}
+
 // Light Units handling
-static uint32_t applyBrightness(const void * /*LightUnit**/ lightUnitPtr,
-                                LightUnitState &unitState,
-                                uint32_t color)
+
+// Rising half of a sine wave: (1 - cos(pi * i / 63)) / 2, scaled to 0..255
+static const uint8_t waveRise[64] = {
+    0, 0, 1, 1, 3, 4, 6, 8, 10, 13, 16, 19, 22, 26, 30, 34,
+    38, 43, 48, 53, 58, 64, 69, 75, 81, 87, 93, 99, 105, 112, 118, 124,
+    131, 137, 143, 150, 156, 162, 168, 174, 180, 186, 191, 197, 202, 207, 212, 217,
+    221, 225, 229, 233, 236, 239, 242, 245, 247, 249, 251, 252, 254, 254, 255, 255};
+
+static const uint32_t pulseDefaultPeriodMs = 4000;
+
+// Where the unit is in its pulse or blink period, from the animation clock. 0..65535 is one full period
+static uint16_t periodPosition(const LightUnit &lightUnit, uint32_t defaultPeriodMs)
+{
+  const LightUnitAnimation &animation = lightUnit.animation;
+  const uint32_t periodMs = animation.periodMs ? animation.periodMs : defaultPeriodMs;
+  const uint32_t position = (uint32_t)(((uint64_t)(animationClockMs % periodMs) << 16) / periodMs);
+  return (uint16_t)(position + animation.phase);
+}
+
+// Blink is on for the first half of its period. By default, the period is two frames of the unit
+static bool isBlinkOff(const LightUnit &lightUnit)
+{
+  const LightUnitAnimation &animation = lightUnit.animation;
+  return periodPosition(lightUnit, 2 * refreshMs * animation.speed * animation.frames) >= 0x8000;
+}
+
+static uint32_t applyBrightness(const void * /*LightUnit**/ lightUnitPtr, uint32_t color)
 {
   const LightUnit &lightUnit =
       *reinterpret_cast<const LightUnit *>(lightUnitPtr);
   uint32_t brightness = (uint32_t)lightUnit.brightness;
-  static const uint32_t brightnessIncr = 12;
   if (lightUnit.animation.pulse)
   {
-    if (unitState.pulseGoingUp)
-    {
-      if (unitState.pulseBrightness >= (250 - brightnessIncr))
-        unitState.pulseGoingUp = !unitState.pulseGoingUp;
-      else
-        unitState.pulseBrightness += brightnessIncr;
-    }
-    else
-    {
-      if (unitState.pulseBrightness <= (2 + brightnessIncr))
-        unitState.pulseGoingUp = !unitState.pulseGoingUp;
-      else
-        unitState.pulseBrightness -= brightnessIncr;
-    }
-    brightness = unitState.pulseBrightness;
+    // Goes from 2 up to 250 and back, on the first and second half of the period
+    const uint8_t index = (uint8_t)(periodPosition(lightUnit, pulseDefaultPeriodMs) >> 9); // 0..127
+    const uint32_t wave = waveRise[index < 64 ? index : 127 - index];
+    brightness = 2 + (wave * 248) / 255;
   }
   // ref: https://github.com/adafruit/Adafruit_Seesaw/blob/fe3634ce7af7451330fff65b150960aa32d581bf/seesaw_neopixel.cpp#L190
   if (color != 0 && brightness != 0)
@@ -278,118 +405,493 @@ static uint32_t applyBrightness(const void * /*LightUnit**/ lightUnitPtr,
   return color;
 }
 
+static void setCachedPixel(int i, uint32_t color)
+{
+  if (pixelColorCache[i] == color)
+    return;
+
+  // If button for this pixel is being pressed, simply make cached value dirty.
+  // And do not mess with the actual pixel. Unless a reaction owns that button.
+  if (getFlag((state.buttons.pressed & ~state.buttons.reactionFeedback) |
+                  state.buttons.abortedPendingPressEvent,
+              i))
+  {
+    pixelColorCache[i] = color | cacheDirtyBit;
+    return;
+  }
+
+  trellis.setPixelColor(i, color); // prep trellis
+  pixelColorCache[i] = color;      // update cache
+  ++pixelColorCacheVersion;        // bump cache
+}
+
+static inline bool isHsvGradient(const LightUnit &lightUnit)
+{
+  const LightUnitAnimation &animation = lightUnit.animation;
+  return animation.hsvColor && animation.hueSpread && !animation.rainbowColor &&
+         !animation.randomColor && !animation.sameRandomColor;
+}
+
+// Units that do not draw from their prng can work out their color at any time, from their state
+static inline bool isRecolorable(const LightUnit &lightUnit)
+{
+  const LightUnitAnimation &animation = lightUnit.animation;
+  return !animation.randomPixels && !animation.randomColor && !animation.sameRandomColor;
+}
+
+static uint32_t lightUnitColor(const LightUnit &lightUnit, LightUnitState &unitState, uint16_t hue)
+{
+  uint32_t color = lightUnit.color;
+  if (lightUnit.animation.rainbowColor)
+    color = Wheel((byte)(hue >> 8));
+  else if (lightUnit.animation.randomColor)
+    color = 1; // anything but zero is good here
+  else if (lightUnit.animation.sameRandomColor)
+    color = prngColor(unitState.rng);
+  else if (lightUnit.animation.hsvColor)
+    color = isHsvGradient(lightUnit) ? 0x00ffffff // hue of each pixel is worked out when blending
+                                     : hsvToRgb(hue, lightUnit.animation.saturation);
+  else if (lightUnit.animation.tweenMs)
+    color = tweenColorAt(lightUnit, lightsClockMs());
+  else if (lightUnit.kind == lightUnitKindIndexed)
+    color = 0x00ffffff; // palette has the colors. This lets brightness and pulse scale them
+  else if (lightUnit.kind == lightUnitKindTable && lightUnit.payload.table.colors[unitState.kindVars[0]])
+    color = lightUnit.payload.table.colors[unitState.kindVars[0]];
+
+  if (lightUnit.animation.blink && isBlinkOff(lightUnit))
+    return 0;
+  return applyBrightness(&lightUnit, color);
+}
+
 static void lightUnitIterate(const void * /*LightUnit**/ lightUnitPtr,
                              LightUnitState &unitState, bool isExpired)
 {
   const LightUnit &lightUnit =
       *reinterpret_cast<const LightUnit *>(lightUnitPtr);
-  uint32_t color = lightUnit.color;
 
-  if (isExpired && !lightUnit.animation.keepPixelWhenDone)
-    color = 0;
-  else if (lightUnit.animation.rainbowColor)
-    color = Wheel();
-  else if (lightUnit.animation.randomColor)
-    color = 1; // anything but zero is good here
-  else if (lightUnit.animation.sameRandomColor)
-    color = random(1, 0x00ffffff);
+  // Once expired, the unit no longer contributes to the frame
+  if (isExpired)
+  {
+    if (!lightUnit.animation.keepPixelWhenDone)
+      composeDirty |= unitState.drawnPixels;
+    unitState.drawnPixels = 0;
+    return;
+  }
 
-  if (lightUnit.animation.blink && ++unitState.tempCounter % 2 == 0)
-    color = 0;
-  else
-    color = applyBrightness(lightUnitPtr, unitState, color);
+  // Each unit moves around the color wheel on its own
+  static const int16_t rainbowHueSpeed = 9 << 8; // about 28 frames around the wheel
+  const uint16_t hue = unitState.hue;
+  if (lightUnit.animation.rainbowColor)
+    unitState.hue += lightUnit.animation.hueSpeed ? lightUnit.animation.hueSpeed : rainbowHueSpeed;
+  else if (lightUnit.animation.hsvColor)
+    unitState.hue += lightUnit.animation.hueSpeed;
+
+  // Hidden units leave their color to the compositor, which only needs it if they show up again
+  const uint64_t covered = unitState.coveredPixels;
+  const bool isOccluded =
+      isRecolorable(lightUnit) && ((unitState.drawnPixels | lightUnit.pixelMask) & ~covered) == 0;
+  uint32_t color = isOccluded ? unitState.drawnColor : lightUnitColor(lightUnit, unitState, hue);
+  unitState.recolor = isOccluded;
+  if (isOccluded)
+    ++occludedUnits;
 
   uint64_t pixels = lightUnit.pixelMask;
   if (lightUnit.animation.randomPixels)
   {
-    // Last one includes all pixels
-    if (isExpired && !lightUnit.animation.keepPixelWhenDone)
-      pixels = ~0ULL;
-    else
-    {
-      // Note: random() returns 31 bits. So, we will shift and xor it with previous value.
-      pixels = random(0, 0x7fffffffUL);
-      pixels ^= unitState.tempPixels * 2;
-      unitState.tempPixels *= 0x100000000;
-      unitState.tempPixels ^= pixels;
-      // Override color to 0 on every 3rd frame
-      if (!lightUnit.animation.blink)
-        ++unitState.tempCounter; // incr only if needed
-      if (unitState.tempCounter % 3 == 0)
-        color = 0;
-    }
+    pixels = prngNext(unitState.rng);
+    // Override color to 0 on every 3rd frame
+    if (++unitState.tempCounter % 3 == 0)
+      color = 0;
   }
 
-  for (int i = 0; pixels && i < 64; ++i)
+  // Note: pixels under replace units above are not blended again. If those units move,
+  //       the pixels they leave get marked then
+  const uint64_t touched = unitState.drawnPixels | pixels;
+  composeDirty |= touched & ~covered;
+  occludedPixels += __builtin_popcountll(touched & covered);
+  unitState.drawnPixels = pixels;
+  unitState.drawnColor = color;
+  unitState.drawnHue = hue;
+  unitState.drawnSeed =
+      (color != 0 && lightUnit.animation.randomColor) ? (uint32_t)prngNext(unitState.rng) | 1 : 0;
+}
+
+static inline uint32_t blendChannels(uint32_t below, uint32_t color, uint8_t blend)
+{
+  uint32_t result = 0;
+  for (int shift = 0; shift < 24; shift += 8)
+  {
+    const uint32_t b = (below >> shift) & 0xff;
+    const uint32_t c = (color >> shift) & 0xff;
+    uint32_t channel;
+    if (blend == lightUnitBlendAdd)
+      channel = b + c > 0xff ? 0xff : b + c;
+    else if (blend == lightUnitBlendMax)
+      channel = b > c ? b : c;
+    else // lightUnitBlendMultiply
+      channel = (b * c + 0xff) >> 8;
+    result |= channel << shift;
+  }
+  return result;
+}
+
+static uint32_t blendColor(const LightUnit &lightUnit, uint32_t below, uint32_t color)
+{
+  switch (lightUnit.blend)
   {
-    if (!clearFlag(pixels, i))
+  case lightUnitBlendAdd:
+  case lightUnitBlendMax:
+  case lightUnitBlendMultiply:
+    return blendChannels(below, color, lightUnit.blend);
+  case lightUnitBlendAlpha:
+  {
+    // red and blue are mixed together, 8 bits apart from each other
+    const uint32_t alpha = lightUnit.alpha ? lightUnit.alpha + 1 : 256;
+    const uint32_t rb = ((color & 0xff00ff) * alpha + (below & 0xff00ff) * (256 - alpha)) >> 8;
+    const uint32_t g = ((color & 0x00ff00) * alpha + (below & 0x00ff00) * (256 - alpha)) >> 8;
+    return (rb & 0xff00ff) | (g & 0x00ff00);
+  }
+  default:
+    return color;
+  }
+}
+
+// Colors an indexed unit shows on this frame: its palette, cycled for kindStep frames and scaled by
+// drawnColor (brightness, pulse, tween). Only worked out again when one of them moved
+static void indexedFramePalette(LightUnitState &unitState, const LightUnitIndexed &indexed)
+{
+  if (unitState.paletteStep == unitState.kindStep && unitState.paletteColor == unitState.drawnColor)
+    return; // noop. Note: zeroed state holds, since a black drawnColor makes a black palette
+  indexedCyclePalette(indexed, unitState.kindStep, unitState.palette);
+  for (size_t index = 0; index < lightUnitPaletteSize; ++index)
+    unitState.palette[index] = blendChannels(unitState.palette[index], unitState.drawnColor, lightUnitBlendMultiply);
+  unitState.paletteStep = unitState.kindStep;
+  unitState.paletteColor = unitState.drawnColor;
+}
+
+// Color a unit contributes to pixel i. randomColor derives one per pixel from the frame's seed
+static uint32_t drawnPixelColor(const LightUnit &lightUnit, int i)
+{
+  const LightUnitState &unitState = lightUnit.state;
+  if (lightUnit.kind == lightUnitKindIndexed)
+    return unitState.palette[indexedPixel(lightUnit.payload.indexed, i)];
+  if (isHsvGradient(lightUnit) && unitState.drawnColor)
+  {
+    const uint16_t hue = unitState.drawnHue + (uint16_t)(lightUnit.animation.hueSpread * i);
+    return blendChannels(hsvToRgb(hue, lightUnit.animation.saturation), unitState.drawnColor,
+                         lightUnitBlendMultiply);
+  }
+  if (!unitState.drawnSeed)
+    return unitState.drawnColor;
+
+  const uint32_t hash = prngPixelColor(unitState.drawnSeed, i);
+  if (lightUnit.animation.rainbowColor)
+    return Wheel((byte)hash);
+  return (hash & 0x00ffffff) ? (hash & 0x00ffffff) : 1;
+}
+
+// Blends the dirty pixels of the frame, from the bottom unit that shows on them up to the top
+static void compositeLights()
+{
+  if (!composeDirty)
+    return; // noop
+
+  // Front to back: what each unit shows on dirty pixels, until replace units cover them all
+  uint64_t uncovered = composeDirty;
+  LightUnit *bottomPtr = nullptr;
+  for (LightUnit *unitPtr = getTopLightUnit(); unitPtr != nullptr && uncovered;
+       unitPtr = getLightUnitBelow(unitPtr))
+  {
+    LightUnitState &unitState = unitPtr->state;
+    unitState.composePixels = unitState.drawnPixels & uncovered;
+    if (!unitState.composePixels)
       continue;
-    if (color != 0 && lightUnit.animation.randomColor)
+    if (unitState.recolor)
     {
-      color = lightUnit.animation.rainbowColor ? Wheel() : random(1, 0x00ffffff);
+      unitState.drawnColor = lightUnitColor(*unitPtr, unitState, unitState.drawnHue);
+      unitState.recolor = false;
     }
-    if (pixelColorCache[i] == color)
-      continue;
+    if (unitPtr->kind == lightUnitKindIndexed)
+      indexedFramePalette(unitState, unitPtr->payload.indexed);
+    bottomPtr = unitPtr;
+    if (unitPtr->blend == lightUnitBlendReplace)
+      uncovered &= ~unitState.drawnPixels;
+  }
 
-    // If button for this pixel is being pressed, simply make cached value dirty.
-    // And do not mess with the actual pixel.
-    if (getFlag(state.buttons.pressed | state.buttons.abortedPendingPressEvent, i))
+  // Back to front: blend them, on top of a dark background
+  for (uint64_t pixels = composeDirty; pixels; pixels &= pixels - 1)
+    composeFrame[__builtin_ctzll(pixels)] = 0;
+  for (LightUnit *unitPtr = bottomPtr; unitPtr != nullptr; unitPtr = getLightUnitAbove(unitPtr))
+  {
+    for (uint64_t pixels = unitPtr->state.composePixels; pixels; pixels &= pixels - 1)
     {
-      pixelColorCache[i] = color | cacheDirtyBit;
-      continue;
+      const int i = __builtin_ctzll(pixels);
+      composeFrame[i] = blendColor(*unitPtr, composeFrame[i], drawnPixelColor(*unitPtr, i));
     }
+  }
 
-    trellis.setPixelColor(i, color); // prep trellis
-    pixelColorCache[i] = color;      // update cache
-    ++pixelColorCacheVersion;        // bump cache
+  for (uint64_t pixels = composeDirty; pixels; pixels &= pixels - 1)
+  {
+    const int i = __builtin_ctzll(pixels);
+    setCachedPixel(i, composeFrame[i]);
   }
+  composeDirty = 0;
 }
 
-void lightUnitFinalIteration(void * /*LightUnit**/ lightUnitPtr,
-                             bool callTrellisShow)
+static void compositeAndShow()
 {
   const int origCacheVersion = pixelColorCacheVersion;
+  compositeLights();
+  if (origCacheVersion != pixelColorCacheVersion)
+    trellis.show();
+}
+
+void lightUnitFinalIteration(void * /*LightUnit**/ lightUnitPtr)
+{
+  // Note: the next fast tick blends and shows what was below it, since the unit
+  //       may still be in lightUnits at this point
   LightUnit &lightUnit = *reinterpret_cast<LightUnit *>(lightUnitPtr);
   lightUnitIterate(lightUnitPtr, lightUnit.state, true /*isExpired*/);
-  if (callTrellisShow &&
-      origCacheVersion != pixelColorCacheVersion)
-    trellis.show();
+}
+
+// Units on more than one frame show only on their step, taking turns with the units on the
+// other steps. Once their step is over, what they drew leaves the frame
+static void lightUnitStepDone(LightUnitState &unitState)
+{
+  composeDirty |= unitState.drawnPixels;
+  unitState.drawnPixels = 0;
+}
+
+void lightUnitRenderNow(LightUnitId id)
+{
+  LightUnit *unitPtr = getLightUnit(id);
+  if (unitPtr == nullptr || unitPtr->animation.step != 0 || unitPtr->state.iterated)
+    return; // not its turn to be drawn; refreshLights will get to it
+  if (unitPtr->iterateCallback)
+    unitPtr->iterateCallback(*unitPtr);
+  lightUnitIterate(unitPtr, unitPtr->state, false /*isExpired*/);
+  unitPtr->state.iterated = true;
+  compositeLights();
+}
+
+static uint64_t transformPixels(uint64_t pixels, uint8_t transform)
+{
+  switch (transform)
+  {
+  case pixelTransformScrollLeft:
+    return bitboardScrollWest(pixels);
+  case pixelTransformScrollRight:
+    return bitboardScrollEast(pixels);
+  case pixelTransformScrollUp:
+    return bitboardScrollNorth(pixels);
+  case pixelTransformScrollDown:
+    return bitboardScrollSouth(pixels);
+  case pixelTransformRotate90:
+    return bitboardRotate90(pixels);
+  case pixelTransformRotate180:
+    return bitboardRotate180(pixels);
+  case pixelTransformRotate270:
+    return bitboardRotate270(pixels);
+  case pixelTransformFlipHorizontal:
+    return bitboardFlipHorizontal(pixels);
+  case pixelTransformFlipVertical:
+    return bitboardFlipVertical(pixels);
+  case pixelTransformTranspose:
+    return bitboardTranspose(pixels);
+  }
+  return pixels;
+}
+
+// Moves pixelMask, dropping pixels it left behind from the frame
+static void setUnitPixels(LightUnit &unit, uint64_t pixels)
+{
+  const uint64_t vacated = unit.state.drawnPixels & ~pixels;
+  unit.pixelMask = pixels;
+  unit.state.drawnPixels &= ~vacated;
+  composeDirty |= vacated;
+}
+
+// Lets the unit's kind move pixelMask to what it draws on this frame
+static void lightUnitKindStep(LightUnit &unit)
+{
+  switch (unit.kind)
+  {
+  case lightUnitKindText:
+    setUnitPixels(unit, textWindow(unit.payload.text, unit.state.kindStep++));
+    break;
+  case lightUnitKindAutomaton:
+    setUnitPixels(unit, automatonNext(unit));
+    break;
+  case lightUnitKindIndexed:
+    ++unit.state.kindStep; // cycles the palette
+    break;
+  case lightUnitKindTable:
+  {
+    const LightUnitTable &table = unit.payload.table;
+    if (table.count == 0)
+      break;
+    // Note: pingPong does not repeat the first and last rows
+    const uint32_t period = (table.pingPong && table.count > 1) ? table.count * 2 - 2 : table.count;
+    const uint32_t position = unit.state.kindStep++ % period;
+    const uint32_t row = position < table.count ? position : period - position;
+    unit.state.kindVars[0] = row;
+    setUnitPixels(unit, table.masks[row]);
+    break;
+  }
+  case lightUnitKindProgram:
+  {
+    uint64_t pixels = unit.pixelMask;
+    if (vmRun(unit, pixels))
+      setUnitPixels(unit, pixels);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static bool lightUnitTransform(LightUnit &unit)
+{
+  const LightUnitAnimation &animation = unit.animation;
+  const uint32_t transformSpeed = animation.transformSpeed ? animation.transformSpeed : 1;
+  if (animation.transform == pixelTransformNone || animation.randomPixels ||
+      unit.kind == lightUnitKindIndexed ||
+      !unit.state.iterated || currRefreshTick % transformSpeed != 0)
+    return false;
+
+  setUnitPixels(unit, transformPixels(unit.pixelMask, animation.transform));
+  return true;
+}
+
+// Tweens that only depend on time can be drawn on every fast tick, for smoother fades
+static bool isFastTween(const LightUnit &lightUnit)
+{
+  const LightUnitAnimation &animation = lightUnit.animation;
+  return animation.tweenMs && animation.frames == 1 && !animation.randomPixels &&
+         !animation.sameRandomColor && !animation.randomColor && !animation.rainbowColor &&
+         !animation.hsvColor && !animation.blink && !animation.pulse;
+}
+
+static void tweenFastTick()
+{
+  if (!fastTweenUnitsCount || clockPaused)
+    return; // noop
+
+  const uint32_t now = lightsClockMs();
+  uint64_t covered = 0; // pixels hidden by units drawn on top of the current one
+  for (LightUnit *unitPtr = getTopLightUnit(); unitPtr != nullptr && covered != ~0ULL;
+       unitPtr = getLightUnitBelow(unitPtr))
+  {
+    LightUnit &unit = *unitPtr;
+    const uint64_t pixels = unit.state.drawnPixels & ~covered;
+    if (unit.blend == lightUnitBlendReplace)
+      covered |= unit.state.drawnPixels;
+    if (!pixels || !unit.state.iterated || unit.paused || !isFastTween(unit))
+      continue;
+
+    unit.state.drawnColor = applyBrightness(unitPtr, tweenColorAt(unit, now));
+    unit.state.recolor = false;
+    composeDirty |= pixels;
+  }
 }
 
 static void refreshLights()
 {
+  const uint32_t refreshStartUs = micros();
   const int origCacheVersion = pixelColorCacheVersion;
+  const bool clockTicked = animationClockTick();
+  uint32_t fastTweenUnits = 0;
+
+  // Front to back: what replace units above each unit hide, as of now
+  uint64_t covered = 0;
+  for (LightUnit *unitPtr = getTopLightUnit(); unitPtr != nullptr; unitPtr = getLightUnitBelow(unitPtr))
+  {
+    unitPtr->state.coveredPixels = covered;
+    if (unitPtr->blend == lightUnitBlendReplace)
+      covered |= unitPtr->state.drawnPixels;
+  }
+
   LightUnit *unitPtr = getFirstLightUnit();
   while (unitPtr != nullptr)
   {
     LightUnit &unit = *unitPtr;
     const LightUnitId currId = unit.id;
+    const uint8_t currLayer = unit.layer;
     const LightUnitAnimation &animation = unit.animation;
     LightUnitState &unitState = unit.state;
 
+    // Paused units keep what they drew last, once they have drawn something.
+    // Same for every unit, until the animation clock moves on
+    if (unit.paused && unitState.iterated)
+    {
+      unitPtr = getNextLightUnit(currId, currLayer);
+      continue;
+    }
+    if (isFastTween(unit))
+      ++fastTweenUnits;
+    if (!clockTicked && unitState.iterated)
+    {
+      unitPtr = getNextLightUnit(currId, currLayer);
+      continue;
+    }
+
     const bool isExpired = (animation.expiration && unitState.age++ >= animation.expiration) ||
                            (animation.dependsOn && !lightUnitExists(animation.dependsOn));
-    if (isExpired ||
+    const bool isTransformed = !isExpired && lightUnitTransform(unit);
+    if (isExpired || isTransformed ||
         (!unitState.iterated && animation.step == 0 && animation.speed > 1) ||
         (currRefreshTick % animation.speed == 0 &&
          (int)(currRefreshTick % animation.frames) == (int)animation.step))
     {
       if (unit.iterateCallback)
         unit.iterateCallback(unit);
+      if (!isExpired)
+        lightUnitKindStep(unit);
       lightUnitIterate(unitPtr, unitState, isExpired);
       unitState.iterated = true;
       if (isExpired)
         rmLightUnit(currId);
     }
-    unitPtr = getNextLightUnit(currId);
+    else if (animation.frames > 1 && currRefreshTick % animation.speed == 0)
+      lightUnitStepDone(unitState);
+    unitPtr = getNextLightUnit(currId, currLayer);
   }
+  fastTweenUnitsCount = fastTweenUnits;
+  compositeLights();
+#ifdef DEBUG
+  const uint32_t frameDoneUs = micros();
+#endif
 
-  // New version means we need to refresh trellis
-  if (origCacheVersion != pixelColorCacheVersion)
+  // New version means we need to refresh trellis. So does a pending ack, even if its command
+  // changed no pixel: it stands for a show that came after the command
+  const bool isShown = origCacheVersion != pixelColorCacheVersion || cmdAcksPending();
+  if (isShown)
     trellis.show();
-  ++currRefreshTick;
+#ifdef DEBUG
+  const uint32_t frameUs = frameDoneUs - refreshStartUs;
+  const uint32_t showUs = micros() - frameDoneUs;
+  ++refreshCount;
+  refreshFrameUs += frameUs;
+  refreshShowUs += showUs;
+  if (frameUs > refreshFrameMaxUs)
+    refreshFrameMaxUs = frameUs;
+  if (showUs > refreshShowMaxUs)
+    refreshShowMaxUs = showUs;
+#endif
+  if (isShown)
+    cmdAckRendered(refreshStartUs);
+  if (clockTicked)
+    ++currRefreshTick;
 }
 
+void lightsRedrawPixels(uint64_t pixels)
+{
+  composeDirty |= pixels;
+}
+
+uint32_t lightsOccludedUnits() { return occludedUnitsLastMin; }
+uint32_t lightsOccludedPixels() { return occludedPixelsLastMin; }
+
 uint64_t getActivePixels()
 {
   uint64_t result = 0;
@@ -1,4 +1,7 @@
 #include "common.h"
+#include "gestures.h"
+#include "keyStats.h"
+#include "vm.h"
 
 #include "tickerScheduler.h"
 
@@ -40,6 +43,11 @@ void setup()
   // stage 2
   initTrellis(ts);
   initButtons(ts);
+  initKeyStats(ts);
+  initScenes(ts);
+  initGestures(ts);
+  initSwipes();
+  initPrograms();
 
   // stage 3
   initMyMqtt(ts);
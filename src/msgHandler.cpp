@@ -1,6 +1,12 @@
 #include "common.h"
 #include "lightUnit.h"
 #include "animations.h"
+#include "automaton.h"
+#include "gestures.h"
+#include "keyStats.h"
+#include "palette.h"
+#include "reactions.h"
+#include "vm.h"
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 #include <String>
@@ -12,7 +18,7 @@ typedef void (*OpHandler)();
 typedef std::map<String, OpHandler> OpHandlers;
 static OpHandlers opHandlers;
 
-void parseMqttCmd(const char *msg, size_t msgSize)
+bool parseMqttCmd(const char *msg, size_t msgSize, uint32_t *seqPtr)
 {
   cmdDoc.clear();
   DeserializationError error = deserializeJson(cmdDoc, msg, msgSize);
@@ -21,9 +27,14 @@ void parseMqttCmd(const char *msg, size_t msgSize)
 #ifdef DEBUG
     Serial.printf("Parsing mqtt msg %s failed: error %s\n", msg, error.c_str());
 #endif
-    return;
+    return false;
   }
 
+  // Optional sequence number, echoed back in the ack topic once rendered
+  const bool hasSeq = cmdDoc.containsKey("seq");
+  if (hasSeq && seqPtr)
+    *seqPtr = cmdDoc["seq"].as<uint32_t>();
+
 #ifdef DEBUG
   Serial.printf("parseMqttCmd got msg of size %zu :\n", cmdDoc.memoryUsage());
   serializeJsonPretty(cmdDoc, Serial);
@@ -36,7 +47,7 @@ void parseMqttCmd(const char *msg, size_t msgSize)
 #ifdef DEBUG
     Serial.printf("parseMqttCmd got no op\n");
 #endif
-    return;
+    return hasSeq;
   }
 
   const String opStr(op);
@@ -45,10 +56,29 @@ void parseMqttCmd(const char *msg, size_t msgSize)
 #ifdef DEBUG
     Serial.printf("parseMqttCmd has no handlers for op %s\n", opStr.c_str());
 #endif
-    return;
+    return hasSeq;
   }
 
   opHandlers[opStr]();
+  return hasSeq;
+}
+
+bool runCmdOp(const char *op)
+{
+  const String opStr(op);
+  OpHandlers::const_iterator iter(opHandlers.find(opStr));
+  if (iter == opHandlers.end())
+  {
+#ifdef DEBUG
+    Serial.printf("runCmdOp has no handlers for op %s\n", opStr.c_str());
+#endif
+    return false;
+  }
+
+  // handlers must not see attributes of the last mqtt cmd
+  cmdDoc.clear();
+  (*iter).second();
+  return true;
 }
 
 // ref: https://github.com/talentdeficit/jsx  and  https://en.wikipedia.org/wiki/IEEE_754
@@ -86,10 +116,10 @@ static uint64_t _get64bitValue(JsonVariantConst value)
   if (JSON.containsKey(#ATTR))           \
   OBJ.ATTR = JSON[#ATTR].as<TYPE>()
 
-#define UNIT_SET64(ATTR) _ATTR_SET64(cmdDoc, lightUnit, ATTR, uint64_t)
-#define UNIT_SET32(ATTR) _ATTR_SET(cmdDoc, lightUnit, ATTR, uint32_t)
-#define UNIT_SET8(ATTR) _ATTR_SET(cmdDoc, lightUnit, ATTR, uint8_t)
-#define UNIT_SETBOOL(ATTR) _ATTR_SET(cmdDoc, lightUnit, ATTR, bool)
+#define UNIT_SET64(ATTR) _ATTR_SET64(uo, lightUnit, ATTR, uint64_t)
+#define UNIT_SET32(ATTR) _ATTR_SET(uo, lightUnit, ATTR, uint32_t)
+#define UNIT_SET8(ATTR) _ATTR_SET(uo, lightUnit, ATTR, uint8_t)
+#define UNIT_SETBOOL(ATTR) _ATTR_SET(uo, lightUnit, ATTR, bool)
 
 #define ANIM_SETID(ATTR) _ATTR_SET(ao, animation, ATTR, int)
 #define ANIM_SET64(ATTR) _ATTR_SET64(ao, animation, ATTR, uint64_t)
@@ -97,25 +127,153 @@ static uint64_t _get64bitValue(JsonVariantConst value)
 #define ANIM_SET8(ATTR) _ATTR_SET(ao, animation, ATTR, uint8_t)
 #define ANIM_SETBOOL(ATTR) _ATTR_SET(ao, animation, ATTR, bool)
 
+static LightUnitIndexed &indexedPayload(LightUnit &lightUnit)
+{
+  if (lightUnit.kind != lightUnitKindIndexed)
+  {
+    lightUnit.kind = lightUnitKindIndexed;
+    memset(&lightUnit.payload, 0, sizeof(lightUnit.payload));
+  }
+  return lightUnit.payload.indexed;
+}
+
+// indices is a hex digit per pixel, starting at pixel 0. palette entries start at paletteAt
+static void parseIndexed(JsonObjectConst uo, LightUnit &lightUnit)
+{
+  const char *indices = uo["indices"];
+  if (indices && !indices[0])
+  {
+    lightUnit.kind = lightUnitKindPixels;
+    return;
+  }
+  if (indices)
+  {
+    LightUnitIndexed &indexed = indexedPayload(lightUnit);
+    memset(indexed.indices, 0, sizeof(indexed.indices));
+    for (int i = 0; indices[i] && i < (int)lightUnitPaletteIndices * 2; ++i)
+    {
+      const char digit = indices[i];
+      if (isxdigit(digit))
+        indexedSetPixel(indexed, i, isdigit(digit) ? digit - '0' : (tolower(digit) - 'a' + 10));
+    }
+    lightUnit.pixelMask = indexedPixelMask(indexed);
+  }
+
+  JsonArrayConst palette = uo["palette"];
+  if (!palette.isNull())
+  {
+    LightUnitIndexed &indexed = indexedPayload(lightUnit);
+    size_t entry = uo["paletteAt"].as<uint8_t>();
+    for (JsonVariantConst color : palette)
+    {
+      if (entry >= lightUnitPaletteSize)
+        break;
+      indexed.palette[entry++] = color.as<uint32_t>();
+    }
+  }
+
+  JsonArrayConst cycle = uo["cycle"];
+  if (!cycle.isNull())
+  {
+    LightUnitIndexed &indexed = indexedPayload(lightUnit);
+    indexed.cycleFirst = cycle[0].as<uint8_t>();
+    indexed.cycleLast = cycle[1].as<uint8_t>();
+    indexed.cycleSteps = cycle[2].as<uint8_t>();
+  }
+}
+
+// table is a list of [pixelMask, color] rows, starting at row tableAt
+static void parseTable(JsonObjectConst uo, LightUnit &lightUnit)
+{
+  JsonArrayConst rows = uo["table"];
+  if (rows.isNull())
+    return;
+  if (rows.size() == 0)
+  {
+    lightUnit.kind = lightUnitKindPixels;
+    return;
+  }
+  if (lightUnit.kind != lightUnitKindTable)
+  {
+    lightUnit.kind = lightUnitKindTable;
+    memset(&lightUnit.payload, 0, sizeof(lightUnit.payload));
+  }
+
+  LightUnitTable &table = lightUnit.payload.table;
+  size_t row = uo["tableAt"].as<uint8_t>();
+  for (JsonArrayConst columns : rows)
+  {
+    if (row >= lightUnitTableSize)
+      break;
+    table.masks[row] = _get64bitValue(columns[0]);
+    table.colors[row] = columns[1].as<uint32_t>();
+    if (++row > table.count)
+      table.count = (uint8_t)row;
+  }
+}
+
 // https://arduinojson.org/v6/api/jsonvariantconst/as/
-void handleSetLightUnit()
+static void parseLightUnit(JsonObjectConst uo, LightUnit &lightUnit)
 {
-  LightUnit lightUnit;
-  const LightUnitId lightUnitId = (LightUnitId)cmdDoc["id"].as<int>();
-  const bool exist = lightUnitExists(lightUnitId, &lightUnit);
   LightUnitAnimation &animation = lightUnit.animation;
-  lightUnit.id = lightUnitId;
 
   UNIT_SET64(pixelMask);
   UNIT_SET32(color);
   UNIT_SET8(brightness);
+  UNIT_SET8(blend);
+  UNIT_SET8(alpha);
+  UNIT_SET32(seed);
+  UNIT_SET8(layer);
+  _ATTR_SET(uo, lightUnit, group, LightUnitGroup);
+  _ATTR_SET(uo, lightUnit, paused, bool);
 
-  if (cmdDoc.containsKey("pixelShiftUp"))
-    lightUnit.pixelMask <<= cmdDoc["pixelShiftUp"].as<int>();
-  if (cmdDoc.containsKey("pixelShiftDown"))
-    lightUnit.pixelMask >>= cmdDoc["pixelShiftDown"].as<int>();
+  const char *text = uo["text"];
+  if (text)
+  {
+    lightUnit.kind = text[0] ? lightUnitKindText : lightUnitKindPixels;
+    memset(&lightUnit.payload, 0, sizeof(lightUnit.payload));
+    strncpy(lightUnit.payload.text, text, lightUnitTextSize - 1);
+  }
 
-  JsonObject ao = cmdDoc["animation"];
+  const char *rule = uo["life"];
+  if (rule)
+  {
+    LightUnitAutomaton automaton;
+    if (!rule[0])
+      lightUnit.kind = lightUnitKindPixels;
+    else if (automatonParseRule(rule, automaton))
+    {
+      lightUnit.kind = lightUnitKindAutomaton;
+      memset(&lightUnit.payload, 0, sizeof(lightUnit.payload));
+      lightUnit.payload.automaton = automaton;
+    }
+#ifdef DEBUG
+    else
+      Serial.printf("Ignoring bad automaton rule %s\n", rule);
+#endif
+  }
+
+  parseIndexed(uo, lightUnit);
+  parseTable(uo, lightUnit);
+  if (lightUnit.kind == lightUnitKindTable && uo.containsKey("tablePingPong"))
+    lightUnit.payload.table.pingPong = uo["tablePingPong"].as<bool>();
+
+  if (uo.containsKey("program"))
+  {
+    const int program = uo["program"].as<int>();
+    const bool isProgram = program >= 0 && program < (int)vmProgramsMax;
+    if (isProgram && lightUnit.kind != lightUnitKindProgram)
+      memset(&lightUnit.payload, 0, sizeof(lightUnit.payload));
+    lightUnit.kind = isProgram ? lightUnitKindProgram : lightUnitKindPixels;
+    lightUnit.payload.program = isProgram ? (uint8_t)program : 0;
+  }
+
+  if (uo.containsKey("pixelShiftUp"))
+    lightUnit.pixelMask <<= uo["pixelShiftUp"].as<int>();
+  if (uo.containsKey("pixelShiftDown"))
+    lightUnit.pixelMask >>= uo["pixelShiftDown"].as<int>();
+
+  JsonObjectConst ao = uo["animation"];
   if (!ao.isNull())
   {
     ANIM_SET32(frames);
@@ -130,7 +288,44 @@ void handleSetLightUnit()
     ANIM_SETBOOL(keepPixelWhenDone);
     ANIM_SETBOOL(blink);
     ANIM_SETBOOL(pulse);
+    ANIM_SET32(tweenColor);
+    ANIM_SET32(tweenMs);
+    ANIM_SET8(tweenEasing);
+    ANIM_SET8(tweenLoop);
+    ANIM_SET8(transform);
+    ANIM_SET32(transformSpeed);
+    ANIM_SETBOOL(hsvColor);
+    _ATTR_SET(ao, animation, hue, uint16_t);
+    _ATTR_SET(ao, animation, hueSpeed, int16_t);
+    _ATTR_SET(ao, animation, hueSpread, int16_t);
+    ANIM_SET8(saturation);
+    ANIM_SET32(periodMs);
+    _ATTR_SET(ao, animation, phase, uint16_t);
   }
+}
+
+// Negative ids belong to reactions, so they cannot be set or removed via mqtt
+static bool parseLightUnitId(LightUnitId &id)
+{
+  id = (LightUnitId)cmdDoc["id"].as<int>();
+  if (id >= 0)
+    return true;
+#ifdef DEBUG
+  Serial.printf("Ignoring %s of LightUnit %d: negative ids are reserved\n", cmdDoc["op"].as<const char *>(),
+                (int)id);
+#endif
+  return false;
+}
+
+void handleSetLightUnit()
+{
+  LightUnit lightUnit;
+  LightUnitId lightUnitId;
+  if (!parseLightUnitId(lightUnitId))
+    return;
+  const bool exist = lightUnitExists(lightUnitId, &lightUnit);
+  lightUnit.id = lightUnitId;
+  parseLightUnit(cmdDoc.as<JsonObjectConst>(), lightUnit);
 
   if (lightUnitId)
   {
@@ -168,18 +363,280 @@ void handleSetLightUnit()
 
 void handleRmLightUnit()
 {
-  LightUnitId id = (LightUnitId)cmdDoc["id"].as<int>();
+  LightUnitId id;
+  if (!parseLightUnitId(id))
+    return;
   if (id)
     rmLightUnit(id);
+  else if (cmdDoc.containsKey("group"))
+    rmLightUnitGroup(cmdDoc["group"].as<LightUnitGroup>());
   else
     rmLightUnits();
 }
 
+// {"op": "pause", "id": 5} or {"op": "resume", "group": 2}. Neither => the whole animation clock
+static void pauseLightUnits(bool paused)
+{
+  LightUnitId id;
+  if (!parseLightUnitId(id))
+    return;
+  if (id)
+    pauseLightUnit(id, paused);
+  else if (cmdDoc.containsKey("group"))
+    pauseLightUnitGroup(cmdDoc["group"].as<LightUnitGroup>(), paused);
+  else
+    lightsClockPause(paused);
+}
+
+void handlePauseLightUnit() { pauseLightUnits(true); }
+void handleResumeLightUnit() { pauseLightUnits(false); }
+
+// {"op": "groupSet", "group": 2, "color": 255}  -- attributes of set, applied to every member
+void handleGroupSet()
+{
+  const LightUnitGroup group = cmdDoc["group"].as<LightUnitGroup>();
+  if (group == 0)
+    return;
+
+  JsonObjectConst uo = cmdDoc.as<JsonObjectConst>();
+  for (LightUnitId id : getLightUnitGroup(group))
+  {
+    LightUnit lightUnit;
+    if (!lightUnitExists(id, &lightUnit))
+      continue; // removed along with an earlier member
+    parseLightUnit(uo, lightUnit);
+    if (!equivalentLightUnits(*getLightUnit(id), lightUnit))
+      setLightUnit(id, lightUnit, false /*rmBeforeAdd*/, true /*quiet*/);
+  }
+}
+
+void handleSceneSave()
+{
+  if (cmdDoc.containsKey("autoRestore"))
+    sceneSetAutoRestore(cmdDoc["autoRestore"].as<bool>());
+  sceneSaveRequest();
+}
+
+void handleSceneLoad()
+{
+  if (!sceneLoad())
+  {
+#ifdef DEBUG
+    Serial.printf("handleSceneLoad has no scene to load\n");
+#endif
+  }
+}
+
+void handleCfg()
+{
+  _ATTR_SET(cmdDoc, state, compactOperState, bool);
+  _ATTR_SET(cmdDoc, state, immediateButtonEvents, bool);
+
+  // Press thresholds are changed together, and only if they stay in order
+  const uint32_t minPressMs =
+      cmdDoc.containsKey("minPressMs") ? cmdDoc["minPressMs"].as<uint32_t>() : state.minPressMs;
+  const uint32_t longPressMs =
+      cmdDoc.containsKey("longPressMs") ? cmdDoc["longPressMs"].as<uint32_t>() : state.longPressMs;
+  const uint32_t maxPressMs =
+      cmdDoc.containsKey("maxPressMs") ? cmdDoc["maxPressMs"].as<uint32_t>() : state.maxPressMs;
+  if (minPressMs > 0 && minPressMs < longPressMs && longPressMs < maxPressMs)
+  {
+    state.minPressMs = minPressMs;
+    state.longPressMs = longPressMs;
+    state.maxPressMs = maxPressMs;
+  }
+#ifdef DEBUG
+  else
+    Serial.printf("cfg ignored press thresholds %" PRIu32 " / %" PRIu32 " / %" PRIu32
+                  ": need 0 < minPressMs < longPressMs < maxPressMs\n",
+                  minPressMs, longPressMs, maxPressMs);
+#endif
+
+  if (cmdDoc.containsKey("timeScale"))
+    lightsClockScale(cmdDoc["timeScale"].as<uint32_t>());
+}
+
+// {"op": "keyHist", "key": 7}  -- key is optional: all buttons combined when not provided
+void handleKeyHist()
+{
+  const int buttonIndex = cmdDoc.containsKey("key") ? cmdDoc["key"].as<int>() : -1;
+  if (buttonIndex >= 64)
+    return;
+  sendHoldHistogram(buttonIndex < 0 ? -1 : buttonIndex);
+}
+
+// {"op": "gesture", "steps": [{"p": mask, "l": mask}, ...], "action": "scan"}
+// {"op": "gesture", "reset": 1}
+void handleGesture()
+{
+  if (cmdDoc["reset"].as<bool>())
+  {
+    gesturesReset();
+    return;
+  }
+
+  Gesture gesture = {0};
+  JsonArrayConst steps = cmdDoc["steps"];
+  for (JsonVariantConst step : steps)
+  {
+    if (gesture.stepsCount >= gestureMaxSteps)
+      break;
+    gesture.steps[gesture.stepsCount].pressed = _get64bitValue(step["p"]);
+    gesture.steps[gesture.stepsCount].longPressed = _get64bitValue(step["l"]);
+    ++gesture.stepsCount;
+  }
+  const char *action = cmdDoc["action"];
+  if (action)
+    strncpy(gesture.action, action, sizeof(gesture.action) - 1);
+
+  if (!gestureSet(gesture))
+  {
+#ifdef DEBUG
+    Serial.printf("handleGesture did not change gestures\n");
+#endif
+  }
+}
+
+// {"op": "reaction", "id": 0, "keys": mask, "on": "press", "chord": 0, "toggle": 1,
+//  "unit": {"color": 255, "animation": {...}}, "action": "scan"}
+// {"op": "reaction", "id": 0}  -- removes reaction 0
+// {"op": "reaction", "reset": 1}
+void handleReaction()
+{
+  if (cmdDoc["reset"].as<bool>())
+  {
+    reactionsReset();
+    return;
+  }
+
+  static const char *const onNames[] = {"press", "long", "release"};
+  static const size_t onNamesSize = sizeof(onNames) / sizeof(onNames[0]);
+  const char *on = cmdDoc["on"];
+  size_t onIndex = 0; // press, when not provided
+  while (on && onIndex < onNamesSize && strcmp(on, onNames[onIndex]) != 0)
+    ++onIndex;
+  if (onIndex == onNamesSize)
+  {
+#ifdef DEBUG
+    Serial.printf("handleReaction ignored: unknown on %s\n", on);
+#endif
+    return;
+  }
+
+  Reaction reaction = {0};
+  reaction.keys = _get64bitValue(cmdDoc["keys"]);
+  reaction.on = (ButtonKeyEvent)onIndex;
+  reaction.chord = cmdDoc["chord"].as<bool>();
+  reaction.toggle = cmdDoc["toggle"].as<bool>();
+  JsonObjectConst uo = cmdDoc["unit"];
+  if (!uo.isNull())
+  {
+    LightUnit lightUnit = {0};
+    parseLightUnit(uo, lightUnit);
+    ReactionUnit &reactionUnit = reaction.unit;
+    reactionUnit.pixelMask = lightUnit.pixelMask;
+    reactionUnit.color = lightUnit.color;
+    reactionUnit.brightness = lightUnit.brightness;
+    reactionUnit.blend = lightUnit.blend;
+    reactionUnit.alpha = lightUnit.alpha;
+    reactionUnit.layer = lightUnit.layer;
+    reactionUnit.seed = lightUnit.seed;
+    reactionUnit.animation = lightUnit.animation;
+  }
+  const char *action = cmdDoc["action"];
+  if (action)
+    strncpy(reaction.action, action, sizeof(reaction.action) - 1);
+
+  if (!reactionSet(cmdDoc["id"].as<uint8_t>(), reaction))
+  {
+#ifdef DEBUG
+    Serial.printf("handleReaction did not change reactions\n");
+#endif
+  }
+}
+
+// {"op": "keyStats", "key": 7}  -- key is optional: all buttons that were used when not provided
+// {"op": "keyStats", "flush": 1}
+// {"op": "keyStats", "reset": 1}
+void handleKeyStats()
+{
+  if (cmdDoc["reset"].as<bool>())
+  {
+    keyStatsReset();
+    return;
+  }
+  if (cmdDoc["flush"].as<bool>())
+  {
+    keyStatsFlush();
+    return;
+  }
+
+  const int buttonIndex = cmdDoc.containsKey("key") ? cmdDoc["key"].as<int>() : -1;
+  if (buttonIndex >= 64)
+    return;
+  sendKeyStats(buttonIndex < 0 ? -1 : buttonIndex);
+}
+
+// {"op": "swipe", "on": "E", "action": "scan"}  -- on: N, NE, E, SE, S, SW, W, NW or drag
+void handleSwipe()
+{
+  const char *on = cmdDoc["on"];
+  const char *action = cmdDoc["action"];
+  if (!on || !swipeActionSet(on, action ? action : ""))
+  {
+#ifdef DEBUG
+    Serial.printf("handleSwipe did not change swipes\n");
+#endif
+  }
+}
+
+// {"op": "program", "slot": 2, "code": "19 1d 1a 00", "at": 0}  -- hex bytes, spaces optional.
+// Code longer than a message fits is sent in chunks, with at set to where each one goes
+void handleProgram()
+{
+  const char *hex = cmdDoc["code"];
+  uint8_t code[vmProgramSize];
+  size_t codeSize = 0;
+  for (int nibbles = 0; hex && *hex; ++hex)
+  {
+    if (!isxdigit(*hex))
+      continue;
+    const uint8_t nibble = isdigit(*hex) ? *hex - '0' : tolower(*hex) - 'a' + 10;
+    if (nibbles++ % 2 == 0)
+    {
+      if (codeSize == sizeof(code))
+        break;
+      code[codeSize++] = nibble << 4;
+    }
+    else
+      code[codeSize - 1] |= nibble;
+  }
+
+  if (!vmProgramSet(cmdDoc["slot"].as<uint8_t>(), cmdDoc["at"].as<uint8_t>(), code, codeSize))
+  {
+#ifdef DEBUG
+    Serial.printf("handleProgram did not change programs\n");
+#endif
+  }
+}
+
 void initCmdOpHandlers()
 {
   opHandlers["set"] = handleSetLightUnit;
   opHandlers["rm"] = handleRmLightUnit;
   opHandlers["clear"] = handleRmLightUnit;
+  opHandlers["pause"] = handlePauseLightUnit;
+  opHandlers["resume"] = handleResumeLightUnit;
+  opHandlers["groupSet"] = handleGroupSet;
+  opHandlers["save"] = handleSceneSave;
+  opHandlers["load"] = handleSceneLoad;
+  opHandlers["cfg"] = handleCfg;
+  opHandlers["gesture"] = handleGesture;
+  opHandlers["swipe"] = handleSwipe;
+  opHandlers["reaction"] = handleReaction;
+  opHandlers["keyHist"] = handleKeyHist;
+  opHandlers["keyStats"] = handleKeyStats;
+  opHandlers["program"] = handleProgram;
 
   opHandlers["flashlight"] = startAnimationFlashlight1;
   opHandlers["flashlight1"] = startAnimationFlashlight1;
@@ -4,11 +4,14 @@
 #include "netConfig.h"
 #include "animations.h"
 #include "colors.h"
+#include "keyStats.h"
+#include "reactions.h"
 #include "tickerScheduler.h"
 
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 #include <ArduinoOTA.h>
+#include <stdarg.h>
 
 // huzzah ref: https://learn.adafruit.com/adafruit-huzzah32-esp32-feather/
 
@@ -16,10 +19,15 @@
 #define MQTT_XUB_CMD "cmd" // xub: sub and pub
 
 #define MQTT_PUB_BUTTONS "buttons"
+#define MQTT_PUB_KEY "key" // per button events, when state.immediateButtonEvents is set
+#define MQTT_PUB_ACK "ack"
+#define MQTT_PUB_KEY_STATS "keyStats" // on request, via cmd ops
+#define MQTT_PUB_SWIPE "swipe"
 #define MQTT_PUB_OPER_STATE_BATTERY "battery"
 #define MQTT_PUB_OPER_STATE_UPTIME "uptime"
 #define MQTT_PUB_OPER_STATE_MEMORY "memory"
 #define MQTT_PUB_OPER_STATE_ETC "etc"
+#define MQTT_PUB_OPER_STATE "state" // all of the above, when state.compactOperState is set
 
 // FWDs
 bool checkWifiConnected();
@@ -39,6 +47,37 @@ static StaticJsonDocument<sizeOfMsgBuff> msgDoc;
 
 MqttState mqttState;
 
+// Commands carrying a seq get acked once the frame they affect is pushed to trellis
+typedef struct
+{
+    uint32_t seq;
+    uint32_t receivedUs;  // when msg was read from mqtt subscription
+    uint32_t parsedUs;    // when parsing and op handling were done
+    uint32_t refreshUs;   // when refreshLights started working on it
+    uint32_t renderedUs;  // when refreshLights was done with trellis.show()
+    bool rendered;
+} CmdAck;
+
+static const size_t maxPendingCmdAcks = 8;
+static CmdAck pendingCmdAcks[maxPendingCmdAcks];
+static size_t pendingCmdAcksSize = 0;
+static LatencyStats cmdAckLatencyStats;
+
+// Key events wait here for myMqttLoop, so the fast tick that saw them never blocks on the broker
+typedef struct
+{
+    int buttonIndex;
+    const char *eventName;
+    uint32_t eventMillis;
+    uint16_t seq;
+    uint32_t heldMs;
+    int32_t lightMs;
+} KeyEventMsg;
+
+static const size_t maxPendingKeyEvents = 16;
+static KeyEventMsg pendingKeyEvents[maxPendingKeyEvents];
+static size_t pendingKeyEventsSize = 0;
+
 // Create an WiFiClient class to connect to the MQTT server.
 WiFiClient client;
 
@@ -49,19 +88,29 @@ typedef struct MqttConfig_t
     Adafruit_MQTT_Publish *service_pub_cmd;
 
     Adafruit_MQTT_Publish *service_pub_buttons;
+    Adafruit_MQTT_Publish *service_pub_key;
+    Adafruit_MQTT_Publish *service_pub_ack;
+    Adafruit_MQTT_Publish *service_pub_key_stats;
+    Adafruit_MQTT_Publish *service_pub_swipe;
     Adafruit_MQTT_Publish *service_pub_oper_state_battery;
     Adafruit_MQTT_Publish *service_pub_oper_state_uptime;
     Adafruit_MQTT_Publish *service_pub_oper_state_memory;
     Adafruit_MQTT_Publish *service_pub_oper_state_etc;
+    Adafruit_MQTT_Publish *service_pub_oper_state;
 
     Adafruit_MQTT_Client *mqttPtr;
     const char *topicPing;
     const char *topicCmd;
     const char *topicButtons;
+    const char *topicKey;
+    const char *topicAck;
+    const char *topicKeyStats;
+    const char *topicSwipe;
     const char *topicOperStateBattery;
     const char *topicOperStateUptime;
     const char *topicOperStateMemory;
     const char *topicOperStateEtc;
+    const char *topicOperState;
 } MqttConfig;
 
 static struct MqttConfig_t mqttConfig = {0};
@@ -156,6 +205,22 @@ void initMyMqtt(TickerScheduler &ts)
     mqttConfig.topicButtons = strdup(tmp.c_str());
     mqttConfig.service_pub_buttons = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicButtons);
 
+    tmp = cnf.mqttTopic + MQTT_PUB_KEY;
+    mqttConfig.topicKey = strdup(tmp.c_str());
+    mqttConfig.service_pub_key = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicKey);
+
+    tmp = cnf.mqttTopic + MQTT_PUB_ACK;
+    mqttConfig.topicAck = strdup(tmp.c_str());
+    mqttConfig.service_pub_ack = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicAck);
+
+    tmp = cnf.mqttTopic + MQTT_PUB_KEY_STATS;
+    mqttConfig.topicKeyStats = strdup(tmp.c_str());
+    mqttConfig.service_pub_key_stats = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicKeyStats);
+
+    tmp = cnf.mqttTopic + MQTT_PUB_SWIPE;
+    mqttConfig.topicSwipe = strdup(tmp.c_str());
+    mqttConfig.service_pub_swipe = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicSwipe);
+
     tmp = cnf.mqttTopic + MQTT_PUB_OPER_STATE_BATTERY;
     mqttConfig.topicOperStateBattery = strdup(tmp.c_str());
     mqttConfig.service_pub_oper_state_battery = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicOperStateBattery);
@@ -172,6 +237,10 @@ void initMyMqtt(TickerScheduler &ts)
     mqttConfig.topicOperStateEtc = strdup(tmp.c_str());
     mqttConfig.service_pub_oper_state_etc = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicOperStateEtc);
 
+    tmp = cnf.mqttTopic + MQTT_PUB_OPER_STATE;
+    mqttConfig.topicOperState = strdup(tmp.c_str());
+    mqttConfig.service_pub_oper_state = new Adafruit_MQTT_Publish(mqttConfig.mqttPtr, mqttConfig.topicOperState);
+
     // Init tickers
     const uint32_t oneSec = 1000;
     const uint32_t oneMin = oneSec * 60;
@@ -196,6 +265,9 @@ void myMqttLoop()
 
     Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
 
+    // Before reading the subscriptions, since that is what the key event lag is made of
+    sendButtonKeyEvents();
+
     // Listen for updates on any subscribed MQTT feeds and process them all.
     Adafruit_MQTT_Subscribe *subscription;
     while ((subscription = mqtt.readSubscription()))
@@ -230,7 +302,23 @@ void myMqttLoop()
             // if strlen of message is 0, that means we caused it due to publish below... silently ignore it
             if (strlen(message) == 0)
                 continue;
-            parseMqttCmd(message, MAXBUFFERSIZE);
+            const uint32_t receivedUs = micros();
+            uint32_t seq = 0;
+            if (parseMqttCmd(message, MAXBUFFERSIZE, &seq))
+            {
+                if (pendingCmdAcksSize < maxPendingCmdAcks)
+                {
+                    CmdAck &cmdAck = pendingCmdAcks[pendingCmdAcksSize++];
+                    memset(&cmdAck, 0, sizeof(cmdAck));
+                    cmdAck.seq = seq;
+                    cmdAck.receivedUs = receivedUs;
+                    cmdAck.parsedUs = micros();
+                }
+#ifdef DEBUG
+                else
+                    Serial.printf("Dropping ack for seq %" PRIu32 ": too many pending\n", seq);
+#endif
+            }
 
             // explicitly clear mqtt topic
             /*const*/ uint8_t foo_payload = ~0;
@@ -249,6 +337,8 @@ void myMqttLoop()
 #endif
         }
     }
+
+    sendCmdAcks();
 }
 
 bool checkWifiConnected()
@@ -452,12 +542,77 @@ static bool sendCommon(const char *const eventName, Adafruit_MQTT_Publish* pubPt
     return true;
 }
 
-bool sendOperState()
+// Allocation free json writer: appends straight into msgBuff
+typedef struct
+{
+    size_t len;
+} MsgWriter;
+
+static void msgWrite(MsgWriter &writer, const char *format, ...)
+{
+    if (writer.len >= sizeOfMsgBuff)
+        return; // overflow: nothing else fits
+
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(msgBuff + writer.len, sizeOfMsgBuff - writer.len, format, args);
+    va_end(args);
+    writer.len = written < 0 ? sizeOfMsgBuff : writer.len + (size_t)written;
+}
+
+static bool sendWriter(const char *const eventName, const MsgWriter &writer, Adafruit_MQTT_Publish *pubPtr)
 {
     Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
-    if (!mqtt.connected())
+    if (writer.len >= sizeOfMsgBuff)
+    {
+#ifdef DEBUG
+        Serial.printf("Unable to fit %s in msgBuff\n", eventName);
+#endif
         return false;
+    }
+#ifdef DEBUG
+    Serial.printf("%s Msg size: %zu\n", msgBuff, writer.len);
+#endif
+    if (!(*pubPtr).publish(msgBuff))
+    {
+#ifdef DEBUG
+        Serial.printf("Unable to publish %s\n", eventName);
+#endif
+        mqtt.disconnect();
+        return false;
+    }
+    bumpMsgCounters(writer.len);
+    return true;
+}
+
+// minutes in a year: 525600. Let's wrap counter to 7 digits to make sure we have enough buffer space
+static const uint32_t minutesWrap = 9999666UL;
 
+static bool sendOperStateCompact()
+{
+    float batteryVoltage;
+    const bool batteryLow = isBatteryLow(&batteryVoltage);
+    // Note: volts are formatted as integers, since printing floats may allocate
+    const uint32_t centiVolts = (uint32_t)(batteryVoltage * 100 + 0.5);
+    const WifiConfigData &cnf = wifiConfig_get();
+
+    // Note: keys are kept short, so msg fits in Adafruit_MQTT's MAXBUFFERSIZE
+    MsgWriter writer = {0};
+    msgWrite(writer, "{\"v\":%" PRIu32 ".%02" PRIu32 ",\"low\":%d",
+             centiVolts / 100, centiVolts % 100, batteryLow ? 1 : 0);
+    msgWrite(writer, ",\"up\":%" PRIu32 ",\"mUp\":%" PRIu32 ",\"dog\":%" PRIu32,
+             state.uptimeInMinutes % minutesWrap, state.mqttUpInMinutes % minutesWrap,
+             state.minutes_since_periodic_ping % minutesWrap);
+    msgWrite(writer, ",\"mMsg\":%zu,\"fKb\":%" PRIu32 ",\"mfKb\":%" PRIu32 ",\"maKb\":%" PRIu32,
+             state.largestMsgSize, ESP.getFreeHeap() / 1024, ESP.getMinFreeHeap() / 1024,
+             ESP.getMaxAllocHeap() / 1024);
+    msgWrite(writer, ",\"px\":\"0x%llx\",\"lu\":%" PRIu32 ",\"wd\":%d}",
+             getActivePixels(), lightUnitsSize(), cnf.needPeriodicPings ? 1 : 0);
+    return sendWriter(MQTT_PUB_OPER_STATE, writer, mqttConfig.service_pub_oper_state);
+}
+
+static bool sendOperStateTopics()
+{
     // battery
     float batteryVoltage;
     const bool batteryLow = isBatteryLow(&batteryVoltage);
@@ -471,8 +626,6 @@ bool sendOperState()
 
     // uptime
     msgDoc.clear();
-    // minutes in a year: 525600. Let's wrap counter to 7 digits to make sure we have enough buffer space
-    static const uint32_t minutesWrap = 9999666UL;
     snprintf(msgBuff, sizeOfMsgBuff, "%" PRIu32, state.uptimeInMinutes % minutesWrap);
     buffToDoc("up");
     snprintf(msgBuff, sizeOfMsgBuff, "%" PRIu32, state.mqttUpInMinutes % minutesWrap);
@@ -506,12 +659,105 @@ bool sendOperState()
     buffToDoc("lightUnitsSize");
     snprintf(msgBuff, sizeOfMsgBuff, "%s", dogWatch ? "yes" : "no");
     buffToDoc("watchDog");
+    snprintf(msgBuff, sizeOfMsgBuff, "%" PRIu32, lightsOccludedUnits());
+    buffToDoc("occludedUnits");
+    snprintf(msgBuff, sizeOfMsgBuff, "%" PRIu32, lightsOccludedPixels());
+    buffToDoc("occludedPixels");
     if (!sendCommon(MQTT_PUB_OPER_STATE_ETC, mqttConfig.service_pub_oper_state_etc))
         return false;
 
     return true;
 }
 
+bool sendOperState()
+{
+    Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
+    if (!mqtt.connected())
+        return false;
+
+#ifdef DEBUG
+    const uint32_t startUs = micros();
+    const uint32_t startFreeHeap = ESP.getFreeHeap();
+    const uint32_t startMinFreeHeap = ESP.getMinFreeHeap();
+#endif
+
+    const bool result = state.compactOperState ? sendOperStateCompact() : sendOperStateTopics();
+
+#ifdef DEBUG
+    Serial.printf("sendOperState compact: %d took %" PRIu32 " us. freeHeap delta: %" PRId32
+                  " minFreeHeap delta: %" PRId32 "\n",
+                  (int)state.compactOperState, (uint32_t)(micros() - startUs),
+                  (int32_t)(ESP.getFreeHeap() - startFreeHeap),
+                  (int32_t)(ESP.getMinFreeHeap() - startMinFreeHeap));
+#endif
+    return result;
+}
+
+bool cmdAcksPending()
+{
+    for (size_t i = 0; i < pendingCmdAcksSize; ++i)
+    {
+        if (!pendingCmdAcks[i].rendered)
+            return true;
+    }
+    return false;
+}
+
+void cmdAckRendered(uint32_t refreshStartUs)
+{
+    const uint32_t now = micros();
+    for (size_t i = 0; i < pendingCmdAcksSize; ++i)
+    {
+        CmdAck &cmdAck = pendingCmdAcks[i];
+        if (cmdAck.rendered)
+            continue;
+        // Note: acks queued after refresh started are picked up by the next one
+        if ((int32_t)(refreshStartUs - cmdAck.parsedUs) < 0)
+            continue;
+        cmdAck.refreshUs = refreshStartUs;
+        cmdAck.renderedUs = now;
+        cmdAck.rendered = true;
+        // Note: here and not when sent, so an ack sent again is not counted twice
+        latencyStatsAdd(cmdAckLatencyStats, cmdAck.renderedUs - cmdAck.receivedUs);
+    }
+}
+
+static bool sendCmdAck(const CmdAck &cmdAck)
+{
+    msgDoc.clear();
+    msgDoc["seq"] = cmdAck.seq;
+    msgDoc["parseUs"] = cmdAck.parsedUs - cmdAck.receivedUs;
+    msgDoc["queueUs"] = cmdAck.refreshUs - cmdAck.parsedUs;
+    msgDoc["showUs"] = cmdAck.renderedUs - cmdAck.receivedUs;
+    msgDoc["p50Us"] = latencyStatsPercentile(cmdAckLatencyStats, 50);
+    msgDoc["p99Us"] = latencyStatsPercentile(cmdAckLatencyStats, 99);
+    return sendCommon(MQTT_PUB_ACK, mqttConfig.service_pub_ack);
+}
+
+// Sends the rendered acks, in order. The ones not sent stay, for when mqtt is back
+bool sendCmdAcks()
+{
+    Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
+    if (!mqtt.connected())
+        return false;
+
+    bool isSending = true;
+    size_t pendingIndex = 0;
+    for (size_t i = 0; i < pendingCmdAcksSize; ++i)
+    {
+        const CmdAck &cmdAck = pendingCmdAcks[i];
+        if (isSending && cmdAck.rendered)
+        {
+            isSending = sendCmdAck(cmdAck);
+            if (isSending)
+                continue;
+        }
+        pendingCmdAcks[pendingIndex++] = cmdAck;
+    }
+    pendingCmdAcksSize = pendingIndex;
+    return isSending;
+}
+
 bool sendButtonEvent()
 {
     Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
@@ -534,6 +780,154 @@ bool sendButtonEvent()
     return sendCommon(MQTT_PUB_BUTTONS, mqttConfig.service_pub_buttons);
 }
 
+static bool sendButtonKeyEvent(const KeyEventMsg &keyEvent)
+{
+    // lag: how long it took from the button edge until now
+    MsgWriter writer = {0};
+    msgWrite(writer, "{\"key\":%d,\"e\":\"%s\",\"ms\":%" PRIu32 ",\"seq\":%u",
+             keyEvent.buttonIndex, keyEvent.eventName, keyEvent.eventMillis, (unsigned)keyEvent.seq);
+    if (keyEvent.heldMs)
+        msgWrite(writer, ",\"heldMs\":%" PRIu32, keyEvent.heldMs);
+    msgWrite(writer, ",\"lag\":%" PRIu32, (uint32_t)(millis() - keyEvent.eventMillis));
+    // lightMs: how long it took a reaction to light up, compared to the broker round trip
+    if (keyEvent.lightMs >= 0)
+    {
+        const LatencyStats &lightStats = reactionsLatencyStats();
+        msgWrite(writer, ",\"lightMs\":%" PRId32 ",\"lightP50\":%" PRIu32 ",\"lightP99\":%" PRIu32,
+                 keyEvent.lightMs, latencyStatsPercentile(lightStats, 50), latencyStatsPercentile(lightStats, 99));
+    }
+    msgWrite(writer, "}");
+    return sendWriter(MQTT_PUB_KEY, writer, mqttConfig.service_pub_key);
+}
+
+void queueButtonKeyEvent(int buttonIndex, const char *eventName, uint32_t eventMillis,
+                         uint16_t seq, uint32_t heldMs, int32_t lightMs)
+{
+    // Note: like any other event, key events are not kept while mqtt is down
+    if (!isMqttConnected())
+        return;
+    if (pendingKeyEventsSize >= maxPendingKeyEvents)
+    {
+#ifdef DEBUG
+        Serial.printf("Dropping %s event of key %d: too many pending\n", eventName, buttonIndex);
+#endif
+        return;
+    }
+
+    // Edges handled by the same fast tick are not in the order they happened (e.g. a press
+    // before a release that came first), so keep them sorted by eventMillis
+    size_t index = pendingKeyEventsSize++;
+    for (; index > 0 && (int32_t)(eventMillis - pendingKeyEvents[index - 1].eventMillis) < 0; --index)
+        pendingKeyEvents[index] = pendingKeyEvents[index - 1];
+    KeyEventMsg &keyEvent = pendingKeyEvents[index];
+    keyEvent.buttonIndex = buttonIndex;
+    keyEvent.eventName = eventName;
+    keyEvent.eventMillis = eventMillis;
+    keyEvent.seq = seq;
+    keyEvent.heldMs = heldMs;
+    keyEvent.lightMs = lightMs;
+}
+
+bool sendButtonKeyEvents()
+{
+    size_t sent = 0;
+    while (sent < pendingKeyEventsSize && sendButtonKeyEvent(pendingKeyEvents[sent]))
+        ++sent;
+
+    // Note: whatever did not go out is tried again once mqtt reconnects
+    memmove(pendingKeyEvents, pendingKeyEvents + sent, (pendingKeyEventsSize - sent) * sizeof(pendingKeyEvents[0]));
+    pendingKeyEventsSize -= sent;
+    return pendingKeyEventsSize == 0;
+}
+
+bool sendHoldHistogram(int buttonIndex)
+{
+    Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
+    if (!mqtt.connected())
+        return false;
+
+    uint32_t buckets[holdHistogramBuckets] = {0};
+    for (int i = 0; i < 64; ++i)
+    {
+        if (buttonIndex >= 0 && i != buttonIndex)
+            continue;
+        for (size_t bucket = 0; bucket < holdHistogramBuckets; ++bucket)
+            buckets[bucket] += state.buttons.holdHistogram[i][bucket];
+    }
+
+    MsgWriter writer = {0};
+    msgWrite(writer, "{\"key\":%d,\"hist\":[", buttonIndex);
+    for (size_t bucket = 0; bucket < holdHistogramBuckets; ++bucket)
+        msgWrite(writer, "%s%" PRIu32, bucket ? "," : "", buckets[bucket]);
+    msgWrite(writer, "]}");
+    return sendWriter(MQTT_PUB_KEY_STATS, writer, mqttConfig.service_pub_key_stats);
+}
+
+bool sendSwipeEvent(const char *eventName, const char *direction, int fromKey, int toKey,
+                    uint64_t path, uint32_t durationMs)
+{
+    Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
+    if (!mqtt.connected())
+        return false;
+
+    // kps: speed, in keys per second
+    const int len = __builtin_popcountll(path);
+    MsgWriter writer = {0};
+    msgWrite(writer, "{\"e\":\"%s\"", eventName);
+    if (direction)
+        msgWrite(writer, ",\"dir\":\"%s\"", direction);
+    msgWrite(writer, ",\"from\":%d,\"to\":%d,\"len\":%d,\"ms\":%" PRIu32 ",\"kps\":%" PRIu32 ",\"path\":\"0x%llx\"}",
+             fromKey, toKey, len, durationMs, durationMs ? (uint32_t)(len - 1) * 1000 / durationMs : 0,
+             (unsigned long long)path);
+    return sendWriter(MQTT_PUB_SWIPE, writer, mqttConfig.service_pub_swipe);
+}
+
+// Keys with no usage are skipped and the rest is split in as many msgs as needed, since
+// all 64 keys would never fit in one. Each entry is [key,presses,longPresses,stuck,holdSecs]
+bool sendKeyStats(int buttonIndex)
+{
+    Adafruit_MQTT_Client &mqtt = *mqttConfig.mqttPtr;
+    if (!mqtt.connected())
+        return false;
+
+    static const size_t keyStatsMsgMaxLen = 110; // leave room for topic, within MAXBUFFERSIZE
+    static const char *const chunkEnd = "],\"end\":%d}";
+    MsgWriter writer = {0};
+    unsigned chunk = 0;
+    size_t entries = 0;
+    bool result = true;
+
+    msgWrite(writer, "{\"n\":%u,\"k\":[", chunk);
+    for (int i = 0; i < 64; ++i)
+    {
+        const KeyUsage &usage = keyStatsGet(i);
+        if ((buttonIndex >= 0 && i != buttonIndex) ||
+            (buttonIndex < 0 && !usage.presses && !usage.stuck))
+            continue;
+
+        const size_t entryStart = writer.len;
+        msgWrite(writer, "%s[%d,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "]", entries ? "," : "",
+                 i, usage.presses, usage.longPresses, usage.stuck, usage.holdSecs);
+        if (writer.len <= keyStatsMsgMaxLen)
+        {
+            ++entries;
+            continue;
+        }
+
+        // Entry did not fit: send what is there and start over with it on the next chunk
+        writer.len = entryStart;
+        msgWrite(writer, chunkEnd, 0);
+        result = sendWriter(MQTT_PUB_KEY_STATS, writer, mqttConfig.service_pub_key_stats) && result;
+        writer.len = 0;
+        msgWrite(writer, "{\"n\":%u,\"k\":[", ++chunk);
+        msgWrite(writer, "[%d,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "]",
+                 i, usage.presses, usage.longPresses, usage.stuck, usage.holdSecs);
+        entries = 1;
+    }
+    msgWrite(writer, chunkEnd, 1);
+    return sendWriter(MQTT_PUB_KEY_STATS, writer, mqttConfig.service_pub_key_stats) && result;
+}
+
 bool isMqttConnected()
 {
     return mqttState.lastMqttConnected;
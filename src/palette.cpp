@@ -0,0 +1,55 @@
+#include "palette.h"
+#include "tween.h"
+
+#include <string.h>
+
+// Indexed units animate by cycling the palette, never by touching their pixels: the palette
+// of the frame is worked out once, and the color of a pixel is its entry in it.
+
+uint8_t indexedPixel(const LightUnitIndexed &indexed, int i)
+{
+  const uint8_t pair = indexed.indices[i >> 1];
+  return (i & 1) ? pair >> 4 : pair & 0x0f;
+}
+
+void indexedSetPixel(LightUnitIndexed &indexed, int i, uint8_t index)
+{
+  uint8_t &pair = indexed.indices[i >> 1];
+  if (i & 1)
+    pair = (pair & 0x0f) | (index << 4);
+  else
+    pair = (pair & 0xf0) | (index & 0x0f);
+}
+
+uint64_t indexedPixelMask(const LightUnitIndexed &indexed)
+{
+  uint64_t result = 0;
+  for (int i = 0; i < (int)lightUnitPaletteIndices * 2; ++i)
+  {
+    if (indexedPixel(indexed, i))
+      result |= 1ULL << i;
+  }
+  return result;
+}
+
+void indexedCyclePalette(const LightUnitIndexed &indexed, uint32_t step, uint32_t *palette)
+{
+  memcpy(palette, indexed.palette, sizeof(indexed.palette));
+  const uint8_t first = indexed.cycleFirst;
+  const uint8_t last = indexed.cycleLast < lightUnitPaletteSize ? indexed.cycleLast : lightUnitPaletteSize - 1;
+  if (first >= last)
+    return;
+
+  // Every cycleSteps frames, each entry in the range takes the color of the next one
+  const uint32_t cycleSteps = indexed.cycleSteps ? indexed.cycleSteps : 1;
+  const uint32_t cycleLength = last - first + 1;
+  const uint32_t fraction = step % cycleSteps;
+  for (uint32_t index = first; index <= last; ++index)
+  {
+    const uint32_t from = first + (index - first + step / cycleSteps) % cycleLength;
+    const uint32_t to = from == last ? first : from + 1;
+    palette[index] = fraction == 0 ? indexed.palette[from]
+                                   : tweenLerpColor(indexed.palette[from], indexed.palette[to],
+                                                    (fraction << 8) / cycleSteps);
+  }
+}
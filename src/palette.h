@@ -0,0 +1,14 @@
+#ifndef _PALETTE_H
+
+#define _PALETTE_H
+
+#include "lightUnit.h"
+
+uint8_t indexedPixel(const LightUnitIndexed &indexed, int i);
+void indexedSetPixel(LightUnitIndexed &indexed, int i, uint8_t index);
+uint64_t indexedPixelMask(const LightUnitIndexed &indexed); // pixels with a non zero index
+
+// palette after it has cycled for step frames, all lightUnitPaletteSize entries of it
+void indexedCyclePalette(const LightUnitIndexed &indexed, uint32_t step, uint32_t *palette);
+
+#endif // _PALETTE_H
@@ -0,0 +1,49 @@
+#ifndef _PRNG_H
+
+#define _PRNG_H
+
+#include <inttypes.h>
+
+// Per unit pseudo random numbers. Arduino random() goes through the esp32 hardware RNG on
+// every call, and it cannot be replayed; these are a few shifts and a multiply, and a unit
+// with a given seed draws the same sequence on every run, on the device or anywhere else.
+// ref: https://prng.di.unimi.it/splitmix64.c and https://en.wikipedia.org/wiki/Xorshift#xorshift*
+
+// spreads a small seed (like a unit id) into a good starting state, never 0
+inline uint64_t prngSeed(uint64_t seed)
+{
+  uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return z ? z : 0x9e3779b97f4a7c15ULL;
+}
+
+// xorshift64*
+inline uint64_t prngNext(uint64_t &state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dULL;
+}
+
+// non black color
+inline uint32_t prngColor(uint64_t &state)
+{
+  const uint32_t color = (uint32_t)(prngNext(state) >> 40);
+  return color ? color : 1;
+}
+
+// Color of pixel i, from a seed drawn once per frame: no state, so pixels can be
+// worked out in any order, only when they are needed
+inline uint32_t prngPixelColor(uint32_t seed, int i)
+{
+  uint32_t hash = (seed ^ ((uint32_t)i * 0x9e3779b9UL)) * 0x85ebca6bUL;
+  hash ^= hash >> 16;
+  hash *= 0xc2b2ae35UL;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+#endif // _PRNG_H
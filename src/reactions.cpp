@@ -0,0 +1,130 @@
+#include "reactions.h"
+
+// Reactions are kept in a small fixed table. The union of all their keys is used
+// to bail out early, so buttons without reactions pay nothing in the button path.
+// Each reaction owns 65 LightUnitIds: one per key, plus one for the chord.
+
+static const int reactionIdsStride = Y_DIM * X_DIM + 1;
+
+static Reaction reactions[reactionsMaxSize];
+static uint64_t reactionsKeys = 0;
+static LatencyStats reactionsLatency = {0};
+
+static LightUnitId reactionUnitId(uint8_t reactionId, int unitIndex)
+{
+  return -(LightUnitId)(reactionId * reactionIdsStride + unitIndex + 1);
+}
+
+static void rmReactionUnits(uint8_t reactionId)
+{
+  for (int i = 0; i < reactionIdsStride; ++i)
+    rmLightUnit(reactionUnitId(reactionId, i));
+}
+
+static void updateReactionsKeys()
+{
+  reactionsKeys = 0;
+  for (size_t i = 0; i < reactionsMaxSize; ++i)
+    reactionsKeys |= reactions[i].keys;
+}
+
+bool reactionSet(uint8_t reactionId, const Reaction &newReaction)
+{
+  if (reactionId >= reactionsMaxSize)
+    return false;
+
+  Reaction &reaction = reactions[reactionId];
+  if (newReaction.keys == 0 && reaction.keys == 0)
+    return false; // noop
+
+  rmReactionUnits(reactionId);
+  reaction = newReaction;
+  reaction.action[reactionActionSize - 1] = 0;
+  updateReactionsKeys();
+  return true;
+}
+
+void reactionsReset()
+{
+  for (uint8_t i = 0; i < reactionsMaxSize; ++i)
+  {
+    if (reactions[i].keys)
+      rmReactionUnits(i);
+  }
+  memset(reactions, 0, sizeof(reactions));
+  reactionsKeys = 0;
+}
+
+static void reactionFire(uint8_t reactionId, int buttonIndex)
+{
+  const Reaction &reaction = reactions[reactionId];
+  const LightUnitId unitId = reactionUnitId(reactionId, reaction.chord ? Y_DIM * X_DIM : buttonIndex);
+
+  if (reaction.toggle && lightUnitExists(unitId))
+  {
+    rmLightUnit(unitId);
+  }
+  else
+  {
+    const ReactionUnit &reactionUnit = reaction.unit;
+    LightUnit unit = {0};
+    unit.pixelMask = reactionUnit.pixelMask;
+    if (unit.pixelMask == 0)
+      unit.pixelMask = reaction.chord ? reaction.keys : 1ULL << buttonIndex;
+    unit.color = reactionUnit.color;
+    unit.brightness = reactionUnit.brightness;
+    unit.blend = reactionUnit.blend;
+    unit.alpha = reactionUnit.alpha;
+    unit.layer = reactionUnit.layer;
+    unit.seed = reactionUnit.seed;
+    unit.animation = reactionUnit.animation;
+    setLightUnit(unitId, unit, false /*rmBeforeAdd*/, true /*quiet*/);
+    lightUnitRenderNow(unitId);
+  }
+
+  if (reaction.action[0])
+  {
+    // Note: copy it, since the action itself may change the reactions
+    char action[reactionActionSize];
+    strncpy(action, reaction.action, sizeof(action));
+    runCmdOp(action);
+  }
+}
+
+int32_t reactionsKeyEvent(int buttonIndex, ButtonKeyEvent keyEvent, uint32_t eventMillis)
+{
+  if (!getFlag(reactionsKeys, buttonIndex))
+    return -1;
+
+  // Note: released (or stuck) button is no longer in pressed mask, but it counts for chords
+  const uint64_t down = state.buttons.pressed | (1ULL << buttonIndex);
+  bool fired = false;
+  for (uint8_t i = 0; i < reactionsMaxSize; ++i)
+  {
+    const Reaction &reaction = reactions[i];
+    if (reaction.on != keyEvent || !getFlag(reaction.keys, buttonIndex))
+      continue;
+    if (reaction.chord && (down & reaction.keys) != reaction.keys)
+      continue;
+    reactionFire(i, buttonIndex);
+    fired = true;
+  }
+  if (!fired)
+    return -1;
+
+  // Push it out before anything else, like publishing the button event
+  showLights();
+  const uint32_t lightMs = millis() - eventMillis;
+  latencyStatsAdd(reactionsLatency, lightMs);
+#ifdef DEBUG
+  Serial.printf("Reaction to button %d lit in %" PRIu32 " ms (p50 %" PRIu32 " p99 %" PRIu32 ")\n",
+                buttonIndex + 1, lightMs, latencyStatsPercentile(reactionsLatency, 50),
+                latencyStatsPercentile(reactionsLatency, 99));
+#endif
+  return (int32_t)lightMs;
+}
+
+const LatencyStats &reactionsLatencyStats()
+{
+  return reactionsLatency;
+}
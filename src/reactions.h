@@ -0,0 +1,46 @@
+#ifndef _REACTIONS_H
+
+#define _REACTIONS_H
+
+#include "buttons.h"
+#include "common.h"
+#include "lightUnit.h"
+
+static const size_t reactionsMaxSize = 16;
+static const size_t reactionActionSize = 16; // including null terminator
+
+// What a reaction lights: the attributes of set that plain units use. Kinds, with their
+// payload, and groups are left out, so the table stays small and out of groupSet's reach
+typedef struct ReactionUnit_t
+{
+  uint64_t pixelMask; // empty => the triggering key(s)
+  uint32_t color;
+  int8_t brightness;
+  uint8_t blend;
+  uint8_t alpha;
+  uint8_t layer;
+  uint32_t seed;
+  LightUnitAnimation animation;
+} ReactionUnit;
+
+// Reactions light units straight from the button path, without waiting for a cmd
+// from the broker. Each one owns a range of negative LightUnitIds, so its units
+// never collide with the ones added via mqtt and are drawn on top of them.
+typedef struct Reaction_t
+{
+  uint64_t keys;                   // buttons that trigger it (0 => slot not in use)
+  ButtonKeyEvent on;               // button event that triggers it
+  bool chord;                      // all keys must be down together. Otherwise, any key does
+  bool toggle;                     // remove unit if it is there, instead of setting it again
+  ReactionUnit unit;               // template of the unit it sets
+  char action[reactionActionSize]; // optional cmd op to run as well
+} Reaction;
+
+bool reactionSet(uint8_t reactionId, const Reaction &reaction); // empty keys removes it
+void reactionsReset();
+
+// Returns how long it took to light up the reaction (ms since button edge), -1 if none fired
+int32_t reactionsKeyEvent(int buttonIndex, ButtonKeyEvent keyEvent, uint32_t eventMillis);
+const LatencyStats &reactionsLatencyStats();
+
+#endif // _REACTIONS_H
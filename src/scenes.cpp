@@ -0,0 +1,436 @@
+#include "common.h"
+#include "lightUnit.h"
+#include "wifiConfig.h"
+#include "tickerScheduler.h"
+
+#include <Preferences.h>
+#include <vector>
+
+// Scenes are snapshots of the light units, kept in nvs as a compact binary blob.
+// Units that use iterateCallback or doneCallback are skipped: function pointers
+// are meaningless after a reflash, and those units are built-in animations anyway.
+
+static const char *const ATTR_SCENE = "scene";
+static const char *const ATTR_SCENE_AUTO_RESTORE = "scene_auto";
+
+static const uint16_t sceneMagic = 0x5354; // "TS"
+static const uint8_t sceneVersion = 13;
+static const size_t sceneMaxUnits = 64;
+static const size_t sceneHeaderSize = 2 + 1 + 1;
+
+// Only bounds what is read back. id, pixelMask, color, brightness, blend, alpha, seed, layer, group,
+// paused, frames, step, speed, expiration, dependsOn, flags, tweenColor, tweenMs, tweenEasing, tweenLoop,
+// transform, transformSpeed, hue, hueSpeed, hueSpread, saturation, periodMs, phase, kind, and a payload
+// that never takes more than the whole union
+static const size_t sceneUnitMaxSize = 4 + 8 + 4 + 1 + 1 + 1 + 4 + 1 + 2 + 1 + 4 + 4 + 4 + 8 + 4 + 2 +
+                                       4 + 4 + 1 + 1 + 1 + 4 + 2 + 2 + 2 + 1 + 4 + 2 + 1 +
+                                       sizeof(LightUnitPayload);
+static const size_t sceneBlobMaxSize = sceneHeaderSize + sceneMaxUnits * sceneUnitMaxSize;
+
+// Only holds a scene while it is being saved or loaded, sized by the units in it
+static std::vector<uint8_t> sceneBlob;
+static NvWear sceneWear = {ATTR_SCENE};
+
+// FWD
+static void scenes1minTick();
+
+static inline void scenePutBytes(const void *bytes, size_t bytesSize)
+{
+  const uint8_t *const first = static_cast<const uint8_t *>(bytes);
+  sceneBlob.insert(sceneBlob.end(), first, first + bytesSize);
+}
+
+template <typename T>
+static inline void scenePut(const T &value)
+{
+  scenePutBytes(&value, sizeof(value));
+}
+
+// Note: reading past the end leaves offset past it too, so a unit can be checked once it is read
+static inline void sceneGetBytes(size_t &offset, void *bytes, size_t bytesSize)
+{
+  if (offset + bytesSize > sceneBlob.size())
+  {
+    memset(bytes, 0, bytesSize);
+    offset = sceneBlob.size() + 1;
+    return;
+  }
+  memcpy(bytes, &sceneBlob[offset], bytesSize);
+  offset += bytesSize;
+}
+
+template <typename T>
+static inline void sceneGet(size_t &offset, T &value)
+{
+  sceneGetBytes(offset, &value, sizeof(value));
+}
+
+static uint16_t animationFlags(const LightUnitAnimation &animation)
+{
+  const bool flags[] = {animation.randomPixels, animation.sameRandomColor,
+                        animation.randomColor, animation.rainbowColor,
+                        animation.keepPixelWhenDone, animation.blink, animation.pulse,
+                        animation.hsvColor};
+  uint16_t result = 0;
+  for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i)
+    if (flags[i])
+      result |= 1 << i;
+  return result;
+}
+
+static void setAnimationFlags(LightUnitAnimation &animation, uint16_t flags)
+{
+  bool *const flagPtrs[] = {&animation.randomPixels, &animation.sameRandomColor,
+                            &animation.randomColor, &animation.rainbowColor,
+                            &animation.keepPixelWhenDone, &animation.blink, &animation.pulse,
+                            &animation.hsvColor};
+  for (size_t i = 0; i < sizeof(flagPtrs) / sizeof(flagPtrs[0]); ++i)
+    *flagPtrs[i] = (flags & (1 << i)) != 0;
+}
+
+// palette entries an indexed unit uses: up to its highest index, or the end of its cycle
+static uint8_t indexedPaletteCount(const LightUnitIndexed &indexed)
+{
+  uint8_t count = indexed.cycleFirst < indexed.cycleLast ? indexed.cycleLast + 1 : 0;
+  for (size_t i = 0; i < lightUnitPaletteIndices; ++i)
+  {
+    const uint8_t highest = (indexed.indices[i] >> 4) > (indexed.indices[i] & 0x0f)
+                                ? indexed.indices[i] >> 4
+                                : indexed.indices[i] & 0x0f;
+    if (highest + 1 > count)
+      count = highest + 1;
+  }
+  return count > lightUnitPaletteSize ? lightUnitPaletteSize : count;
+}
+
+// Only what the kind of the unit uses: nothing for plain pixels, the text without its padding,
+// the table rows in use
+static void scenePutPayload(const LightUnit &unit)
+{
+  const LightUnitPayload &payload = unit.payload;
+  switch (unit.kind)
+  {
+  case lightUnitKindText:
+  {
+    const uint8_t textSize = (uint8_t)strnlen(payload.text, lightUnitTextSize - 1);
+    scenePut(textSize);
+    scenePutBytes(payload.text, textSize);
+    break;
+  }
+  case lightUnitKindAutomaton:
+    scenePut(payload.automaton.birth);
+    scenePut(payload.automaton.survive);
+    scenePut(payload.automaton.wrap);
+    break;
+  case lightUnitKindIndexed:
+  {
+    const LightUnitIndexed &indexed = payload.indexed;
+    const uint8_t paletteCount = indexedPaletteCount(indexed);
+    scenePut(indexed.indices);
+    scenePut(paletteCount);
+    scenePutBytes(indexed.palette, paletteCount * sizeof(indexed.palette[0]));
+    scenePut(indexed.cycleFirst);
+    scenePut(indexed.cycleLast);
+    scenePut(indexed.cycleSteps);
+    break;
+  }
+  case lightUnitKindProgram:
+    scenePut(payload.program);
+    break;
+  case lightUnitKindTable:
+  {
+    const LightUnitTable &table = payload.table;
+    const uint8_t count = table.count > lightUnitTableSize ? lightUnitTableSize : table.count;
+    scenePut(count);
+    scenePut(table.pingPong);
+    scenePutBytes(table.masks, count * sizeof(table.masks[0]));
+    scenePutBytes(table.colors, count * sizeof(table.colors[0]));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Note: false if the sizes in the blob do not fit the payload
+static bool sceneGetPayload(size_t &offset, LightUnit &unit)
+{
+  LightUnitPayload &payload = unit.payload;
+  switch (unit.kind)
+  {
+  case lightUnitKindPixels:
+    return true;
+  case lightUnitKindText:
+  {
+    uint8_t textSize;
+    sceneGet(offset, textSize);
+    if (textSize >= lightUnitTextSize)
+      return false;
+    sceneGetBytes(offset, payload.text, textSize);
+    payload.text[textSize] = 0;
+    return true;
+  }
+  case lightUnitKindAutomaton:
+    sceneGet(offset, payload.automaton.birth);
+    sceneGet(offset, payload.automaton.survive);
+    sceneGet(offset, payload.automaton.wrap);
+    return true;
+  case lightUnitKindIndexed:
+  {
+    LightUnitIndexed &indexed = payload.indexed;
+    uint8_t paletteCount;
+    sceneGet(offset, indexed.indices);
+    sceneGet(offset, paletteCount);
+    if (paletteCount > lightUnitPaletteSize)
+      return false;
+    sceneGetBytes(offset, indexed.palette, paletteCount * sizeof(indexed.palette[0]));
+    sceneGet(offset, indexed.cycleFirst);
+    sceneGet(offset, indexed.cycleLast);
+    sceneGet(offset, indexed.cycleSteps);
+    return true;
+  }
+  case lightUnitKindProgram:
+    sceneGet(offset, payload.program);
+    return true;
+  case lightUnitKindTable:
+  {
+    LightUnitTable &table = payload.table;
+    sceneGet(offset, table.count);
+    sceneGet(offset, table.pingPong);
+    if (table.count > lightUnitTableSize)
+      return false;
+    sceneGetBytes(offset, table.masks, table.count * sizeof(table.masks[0]));
+    sceneGetBytes(offset, table.colors, table.count * sizeof(table.colors[0]));
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+static size_t sceneSerialize()
+{
+  uint8_t unitsCount = 0;
+
+  sceneBlob.clear();
+  scenePut(sceneMagic);
+  scenePut(sceneVersion);
+  scenePut(unitsCount); // set below
+  for (LightUnit *unitPtr = getFirstLightUnit(); unitPtr != nullptr;
+       unitPtr = getLightUnitAbove(unitPtr))
+  {
+    const LightUnit &unit = *unitPtr;
+    if (unit.iterateCallback || unit.doneCallback)
+      continue;
+    if (unitsCount >= sceneMaxUnits)
+    {
+#ifdef DEBUG
+      Serial.printf("Scene is full: skipping LightUnit %d\n", (int)unit.id);
+#endif
+      continue;
+    }
+
+    const LightUnitAnimation &animation = unit.animation;
+    scenePut((int32_t)unit.id);
+    scenePut(unit.pixelMask);
+    scenePut(unit.color);
+    scenePut(unit.brightness);
+    scenePut(unit.blend);
+    scenePut(unit.alpha);
+    scenePut(unit.seed);
+    scenePut(unit.layer);
+    scenePut(unit.group);
+    scenePut(unit.paused);
+    scenePut(animation.frames);
+    scenePut(animation.step);
+    scenePut(animation.speed);
+    scenePut(animation.expiration);
+    scenePut((int32_t)animation.dependsOn);
+    scenePut(animationFlags(animation));
+    scenePut(animation.tweenColor);
+    scenePut(animation.tweenMs);
+    scenePut(animation.tweenEasing);
+    scenePut(animation.tweenLoop);
+    scenePut(animation.transform);
+    scenePut(animation.transformSpeed);
+    scenePut(animation.hue);
+    scenePut(animation.hueSpeed);
+    scenePut(animation.hueSpread);
+    scenePut(animation.saturation);
+    scenePut(animation.periodMs);
+    scenePut(animation.phase);
+    scenePut(unit.kind);
+    scenePutPayload(unit);
+    ++unitsCount;
+  }
+
+  sceneBlob[sceneHeaderSize - 1] = unitsCount;
+  return sceneBlob.size();
+}
+
+// Note: false if the unit does not fit in what is left of the blob
+static bool sceneGetUnit(size_t &offset, LightUnitId &id, LightUnit &unit)
+{
+  LightUnitAnimation &animation = unit.animation;
+  int32_t savedId;
+  int32_t dependsOn;
+  uint16_t flags;
+
+  unit = LightUnit();
+  sceneGet(offset, savedId);
+  sceneGet(offset, unit.pixelMask);
+  sceneGet(offset, unit.color);
+  sceneGet(offset, unit.brightness);
+  sceneGet(offset, unit.blend);
+  sceneGet(offset, unit.alpha);
+  sceneGet(offset, unit.seed);
+  sceneGet(offset, unit.layer);
+  sceneGet(offset, unit.group);
+  sceneGet(offset, unit.paused);
+  sceneGet(offset, animation.frames);
+  sceneGet(offset, animation.step);
+  sceneGet(offset, animation.speed);
+  sceneGet(offset, animation.expiration);
+  sceneGet(offset, dependsOn);
+  sceneGet(offset, flags);
+  sceneGet(offset, animation.tweenColor);
+  sceneGet(offset, animation.tweenMs);
+  sceneGet(offset, animation.tweenEasing);
+  sceneGet(offset, animation.tweenLoop);
+  sceneGet(offset, animation.transform);
+  sceneGet(offset, animation.transformSpeed);
+  sceneGet(offset, animation.hue);
+  sceneGet(offset, animation.hueSpeed);
+  sceneGet(offset, animation.hueSpread);
+  sceneGet(offset, animation.saturation);
+  sceneGet(offset, animation.periodMs);
+  sceneGet(offset, animation.phase);
+  sceneGet(offset, unit.kind);
+  const bool payloadFits = sceneGetPayload(offset, unit);
+  id = (LightUnitId)savedId;
+  animation.dependsOn = (LightUnitId)dependsOn;
+  setAnimationFlags(animation, flags);
+  return payloadFits && offset <= sceneBlob.size();
+}
+
+static bool sceneDeserialize()
+{
+  uint16_t magic;
+  uint8_t version;
+  uint8_t unitsCount;
+  size_t offset = 0;
+
+  sceneGet(offset, magic);
+  sceneGet(offset, version);
+  sceneGet(offset, unitsCount);
+
+  // Check all of it first, so a bogus blob leaves the current units alone
+  const size_t unitsOffset = offset;
+  LightUnitId id;
+  LightUnit unit;
+  bool isValid = magic == sceneMagic && version == sceneVersion;
+  for (uint8_t i = 0; isValid && i < unitsCount; ++i)
+    isValid = sceneGetUnit(offset, id, unit) && id != 0; // 0 is a reserved id
+  if (!isValid || offset != sceneBlob.size())
+  {
+#ifdef DEBUG
+    Serial.printf("Ignoring scene with unexpected format: magic 0x%x version %u size %zu\n",
+                  magic, version, sceneBlob.size());
+#endif
+    return false;
+  }
+
+  rmLightUnits();
+  offset = unitsOffset;
+  for (uint8_t i = 0; i < unitsCount; ++i)
+  {
+    sceneGetUnit(offset, id, unit);
+    setLightUnit(id, unit, false /*rmBeforeAdd*/, true /*quiet*/);
+  }
+
+#ifdef DEBUG
+  Serial.printf("Scene loaded %u LightUnits\n", unitsCount);
+#endif
+  return true;
+}
+
+// Done with the blob: give its memory back
+static void sceneBlobRelease()
+{
+  std::vector<uint8_t>().swap(sceneBlob);
+}
+
+static size_t sceneRead(Preferences &preferences)
+{
+  const size_t blobSize = preferences.getBytesLength(ATTR_SCENE);
+  if (blobSize == 0 || blobSize > sceneBlobMaxSize)
+    return 0;
+  sceneBlob.resize(blobSize);
+  if (preferences.getBytes(ATTR_SCENE, sceneBlob.data(), blobSize) != blobSize)
+  {
+    sceneBlobRelease();
+    return 0;
+  }
+  return blobSize;
+}
+
+static void sceneSave()
+{
+  const size_t blobSize = sceneSerialize();
+  nvWearPutBytes(sceneWear, sceneBlob.data(), blobSize);
+  sceneBlobRelease();
+}
+
+void sceneSaveRequest()
+{
+  if (nvWearSaveIsDue(sceneWear))
+    sceneSave();
+}
+
+bool sceneLoad()
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, true /*readOnly*/);
+  const size_t blobSize = sceneRead(preferences);
+  preferences.end();
+
+  const bool result = blobSize != 0 && sceneDeserialize();
+  sceneBlobRelease();
+  return result;
+}
+
+void sceneSetAutoRestore(bool autoRestore)
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  if (preferences.getBool(ATTR_SCENE_AUTO_RESTORE) != autoRestore)
+    preferences.putBool(ATTR_SCENE_AUTO_RESTORE, autoRestore);
+  preferences.end();
+}
+
+void initScenes(TickerScheduler &ts)
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, true /*readOnly*/);
+  const bool autoRestore = preferences.getBool(ATTR_SCENE_AUTO_RESTORE);
+  const size_t blobSize = sceneRead(preferences);
+  preferences.end();
+
+  // Remember what is in nvs, so an unchanged scene is never rewritten
+  sceneWear.savedHash = blobSize ? nvWearHash(sceneBlob.data(), blobSize) : 0;
+  if (autoRestore && blobSize)
+    sceneDeserialize();
+  sceneBlobRelease();
+
+  // Init tickers
+  const uint32_t oneSec = 1000;
+  const uint32_t oneMin = oneSec * 60;
+
+  ts.sched(scenes1minTick, oneMin);
+}
+
+static void scenes1minTick()
+{
+  if (sceneWear.saveIsPending)
+    sceneSaveRequest();
+}
@@ -0,0 +1,161 @@
+#include "common.h"
+#include "bitboard.h"
+#include "gestures.h"
+#include "wifiConfig.h"
+
+#include <Preferences.h>
+
+// A trail is a run of presses where each key is next to the previous one. Once none of
+// its keys is down for a little while, the trail gets classified: quick and straight
+// runs are swipes, while runs where the finger never left the keys are drags.
+
+static const char *const ATTR_SWIPES = "swipes";
+
+static const uint32_t swipeStepMaxMs = 300;   // max time between presses of consecutive keys
+static const uint32_t swipeIdleMs = 150;      // trail is done when none of its keys is down for this long
+static const uint32_t swipeMaxMsPerKey = 120; // swipes are at least this fast
+static const int swipeMinKeys = 3;
+
+// Triggers: 8 swipe directions, plus drag
+static const char *const swipeTriggerNames[] = {"N", "NE", "E", "SE", "S", "SW", "W", "NW", "drag"};
+static const size_t swipeTriggersSize = sizeof(swipeTriggerNames) / sizeof(swipeTriggerNames[0]);
+static const int swipeDragTrigger = 8;
+
+// indexed by [dy + 1][dx + 1]
+static const int8_t swipeDirections[3][3] = {{7, 0, 1}, {6, -1, 2}, {5, 4, 3}};
+
+typedef struct
+{
+  uint64_t path; // keys in the trail (0 => no trail)
+  int firstKey;
+  int lastKey;
+  int dx; // direction of the first step
+  int dy;
+  bool straight;   // all steps went in the same direction
+  bool continuous; // every key went down before the previous one went up
+  uint32_t startMillis;
+  uint32_t lastPressMillis;
+  uint32_t lastEdgeMillis; // last time a key in the trail went down or up
+} SwipeTrail;
+
+static SwipeTrail trail = {0};
+static char swipeActions[swipeTriggersSize][gestureActionSize];
+
+static void swipeTrailDone()
+{
+  const SwipeTrail done = trail;
+  trail.path = 0;
+
+  const int len = bitboardCount(done.path);
+  const uint32_t durationMs = done.lastPressMillis - done.startMillis;
+  int trigger = -1;
+  if (len >= swipeMinKeys && done.straight && durationMs <= (uint32_t)(len - 1) * swipeMaxMsPerKey)
+    trigger = swipeDirections[done.dy + 1][done.dx + 1];
+  else if (len >= swipeMinKeys && done.continuous)
+    trigger = swipeDragTrigger;
+  if (trigger < 0)
+    return;
+
+#ifdef DEBUG
+  Serial.printf("%s %s from %d to %d: %d keys in %" PRIu32 " ms\n",
+                trigger == swipeDragTrigger ? "Drag" : "Swipe", swipeTriggerNames[trigger],
+                done.firstKey + 1, done.lastKey + 1, len, durationMs);
+#endif
+  sendSwipeEvent(trigger == swipeDragTrigger ? "drag" : "swipe",
+                 trigger == swipeDragTrigger ? nullptr : swipeTriggerNames[trigger],
+                 done.firstKey, done.lastKey, done.path, durationMs);
+  if (swipeActions[trigger][0])
+    gestureRunAction(swipeActions[trigger]);
+}
+
+static bool swipeTrailExtends(int buttonIndex, uint32_t eventMillis, bool lastStillDown)
+{
+  if (getFlag(trail.path, buttonIndex) || !bitboardAdjacent(trail.lastKey, buttonIndex))
+    return false;
+  return lastStillDown || eventMillis - trail.lastPressMillis <= swipeStepMaxMs;
+}
+
+void swipeKeyEdge(int buttonIndex, bool pressed, uint32_t eventMillis)
+{
+  if (!pressed)
+  {
+    if (getFlag(trail.path, buttonIndex))
+      trail.lastEdgeMillis = eventMillis;
+    return;
+  }
+
+  if (trail.path)
+  {
+    // Note: release of last key may be seen after this press, so go by the timestamps
+    const bool lastStillDown =
+        getFlag(state.buttons.pressed, trail.lastKey) ||
+        (int32_t)(state.buttons.releaseMillis[trail.lastKey] - eventMillis) >= 0;
+    if (swipeTrailExtends(buttonIndex, eventMillis, lastStillDown))
+    {
+      const int dx = bitboardX(buttonIndex) - bitboardX(trail.lastKey);
+      const int dy = bitboardY(buttonIndex) - bitboardY(trail.lastKey);
+      if (bitboardCount(trail.path) == 1)
+      {
+        trail.dx = dx;
+        trail.dy = dy;
+      }
+      else if (dx != trail.dx || dy != trail.dy)
+        trail.straight = false;
+      trail.continuous = trail.continuous && lastStillDown;
+      trail.path |= bitboardBit(buttonIndex);
+      trail.lastKey = buttonIndex;
+      trail.lastPressMillis = eventMillis;
+      trail.lastEdgeMillis = eventMillis;
+      return;
+    }
+    swipeTrailDone();
+  }
+
+  trail.path = bitboardBit(buttonIndex);
+  trail.firstKey = trail.lastKey = buttonIndex;
+  trail.dx = trail.dy = 0;
+  trail.straight = trail.continuous = true;
+  trail.startMillis = trail.lastPressMillis = trail.lastEdgeMillis = eventMillis;
+}
+
+void swipesFastTick()
+{
+  if (!trail.path || (state.buttons.pressed & trail.path))
+    return;
+  if (millis() - trail.lastEdgeMillis > swipeIdleMs)
+    swipeTrailDone();
+}
+
+bool swipeActionSet(const char *triggerName, const char *action)
+{
+  size_t trigger = 0;
+  while (trigger < swipeTriggersSize && strcmp(triggerName, swipeTriggerNames[trigger]) != 0)
+    ++trigger;
+  if (trigger == swipeTriggersSize)
+    return false;
+
+  char *const swipeAction = swipeActions[trigger];
+  if (strncmp(swipeAction, action, gestureActionSize - 1) == 0)
+    return true; // noop
+  strncpy(swipeAction, action, gestureActionSize - 1);
+  swipeAction[gestureActionSize - 1] = 0;
+
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  preferences.putBytes(ATTR_SWIPES, swipeActions, sizeof(swipeActions));
+  preferences.end();
+  return true;
+}
+
+void initSwipes()
+{
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, true /*readOnly*/);
+  if (preferences.getBytesLength(ATTR_SWIPES) != sizeof(swipeActions) ||
+      preferences.getBytes(ATTR_SWIPES, swipeActions, sizeof(swipeActions)) != sizeof(swipeActions))
+    memset(swipeActions, 0, sizeof(swipeActions));
+  preferences.end();
+
+  for (size_t i = 0; i < swipeTriggersSize; ++i)
+    swipeActions[i][gestureActionSize - 1] = 0;
+}
@@ -0,0 +1,116 @@
+#include "text.h"
+#include "bitboard.h"
+
+#include <ctype.h>
+#include <string.h>
+
+// Glyphs are 5 columns wide and 7 rows tall, one byte per column with bit 0 at the top.
+// Only 0x20 ('space') to 0x5f ('_') are in the table: lower case letters are shown in
+// upper case and anything else as '?'. As a const table, it stays in flash.
+
+static const uint8_t fontFirstChar = 0x20;
+static const uint8_t fontLastChar = 0x5f;
+static const uint32_t glyphWidth = 5;
+static const uint32_t glyphPitch = glyphWidth + 1; // 1 blank column between glyphs
+static const uint32_t textGapColumns = 8;          // blank screen between repetitions
+
+static const uint8_t fontColumns[fontLastChar - fontFirstChar + 1][glyphWidth] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, //  
+    {0x00, 0x00, 0x5f, 0x00, 0x00}, // !
+    {0x00, 0x07, 0x00, 0x07, 0x00}, // "
+    {0x14, 0x7f, 0x14, 0x7f, 0x14}, // #
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12}, // $
+    {0x23, 0x13, 0x08, 0x64, 0x62}, // %
+    {0x36, 0x49, 0x55, 0x22, 0x50}, // &
+    {0x00, 0x00, 0x07, 0x00, 0x00}, // '
+    {0x00, 0x1c, 0x22, 0x41, 0x00}, // (
+    {0x00, 0x41, 0x22, 0x1c, 0x00}, // )
+    {0x14, 0x08, 0x3e, 0x08, 0x14}, // *
+    {0x08, 0x08, 0x3e, 0x08, 0x08}, // +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, // ,
+    {0x08, 0x08, 0x08, 0x08, 0x08}, // -
+    {0x00, 0x60, 0x60, 0x00, 0x00}, // .
+    {0x20, 0x10, 0x08, 0x04, 0x02}, // /
+    {0x3e, 0x51, 0x49, 0x45, 0x3e}, // 0
+    {0x00, 0x42, 0x7f, 0x40, 0x00}, // 1
+    {0x42, 0x61, 0x51, 0x49, 0x46}, // 2
+    {0x21, 0x41, 0x45, 0x4b, 0x31}, // 3
+    {0x18, 0x14, 0x12, 0x7f, 0x10}, // 4
+    {0x27, 0x45, 0x45, 0x45, 0x39}, // 5
+    {0x3c, 0x4a, 0x49, 0x49, 0x30}, // 6
+    {0x01, 0x71, 0x09, 0x05, 0x03}, // 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, // 8
+    {0x06, 0x49, 0x49, 0x29, 0x1e}, // 9
+    {0x00, 0x36, 0x36, 0x00, 0x00}, // :
+    {0x00, 0x56, 0x36, 0x00, 0x00}, // ;
+    {0x08, 0x14, 0x22, 0x41, 0x00}, // <
+    {0x14, 0x14, 0x14, 0x14, 0x14}, // =
+    {0x00, 0x41, 0x22, 0x14, 0x08}, // >
+    {0x02, 0x01, 0x51, 0x09, 0x06}, // ?
+    {0x32, 0x49, 0x79, 0x41, 0x3e}, // @
+    {0x7e, 0x09, 0x09, 0x09, 0x7e}, // A
+    {0x7f, 0x49, 0x49, 0x49, 0x36}, // B
+    {0x3e, 0x41, 0x41, 0x41, 0x22}, // C
+    {0x7f, 0x41, 0x41, 0x22, 0x1c}, // D
+    {0x7f, 0x49, 0x49, 0x49, 0x41}, // E
+    {0x7f, 0x09, 0x09, 0x09, 0x01}, // F
+    {0x3e, 0x41, 0x49, 0x49, 0x7a}, // G
+    {0x7f, 0x08, 0x08, 0x08, 0x7f}, // H
+    {0x00, 0x41, 0x7f, 0x41, 0x00}, // I
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, // J
+    {0x7f, 0x08, 0x14, 0x22, 0x41}, // K
+    {0x7f, 0x40, 0x40, 0x40, 0x40}, // L
+    {0x7f, 0x02, 0x0c, 0x02, 0x7f}, // M
+    {0x7f, 0x04, 0x08, 0x10, 0x7f}, // N
+    {0x3e, 0x41, 0x41, 0x41, 0x3e}, // O
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, // P
+    {0x3e, 0x41, 0x51, 0x21, 0x5e}, // Q
+    {0x7f, 0x09, 0x19, 0x29, 0x46}, // R
+    {0x46, 0x49, 0x49, 0x49, 0x31}, // S
+    {0x01, 0x01, 0x7f, 0x01, 0x01}, // T
+    {0x3f, 0x40, 0x40, 0x40, 0x3f}, // U
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, // V
+    {0x3f, 0x40, 0x38, 0x40, 0x3f}, // W
+    {0x63, 0x14, 0x08, 0x14, 0x63}, // X
+    {0x07, 0x08, 0x70, 0x08, 0x07}, // Y
+    {0x61, 0x51, 0x49, 0x45, 0x43}, // Z
+    {0x00, 0x7f, 0x41, 0x41, 0x00}, // [
+    {0x02, 0x04, 0x08, 0x10, 0x20}, // backslash
+    {0x00, 0x41, 0x41, 0x7f, 0x00}, // ]
+    {0x04, 0x02, 0x01, 0x02, 0x04}, // ^
+    {0x40, 0x40, 0x40, 0x40, 0x40}, // _
+};
+
+static inline const uint8_t *glyphOf(char c)
+{
+  c = (char)toupper((unsigned char)c);
+  if (c < (char)fontFirstChar || c > (char)fontLastChar)
+    c = '?';
+  return fontColumns[c - fontFirstChar];
+}
+
+uint32_t textColumns(const char *text)
+{
+  return textGapColumns + (uint32_t)strnlen(text, lightUnitTextSize) * glyphPitch;
+}
+
+static uint8_t textColumn(const char *text, uint32_t column)
+{
+  // Leading blank columns, so text scrolls in from the right edge
+  if (column < textGapColumns)
+    return 0;
+  column -= textGapColumns;
+  const uint32_t glyphColumn = column % glyphPitch;
+  return glyphColumn < glyphWidth ? glyphOf(text[column / glyphPitch])[glyphColumn] : 0;
+}
+
+uint64_t textWindow(const char *text, uint32_t step)
+{
+  const uint32_t totalColumns = textColumns(text);
+  uint64_t columns = 0;
+  for (uint32_t x = 0; x < 8; ++x)
+    columns |= (uint64_t)textColumn(text, (step + x) % totalColumns) << (x * 8);
+
+  // Every byte holds a column. Transposing it makes every byte a row, like pixelMask
+  return bitboardTranspose(columns);
+}
@@ -0,0 +1,11 @@
+#ifndef _TEXT_H
+
+#define _TEXT_H
+
+#include "lightUnit.h"
+
+// pixelMask showing the 8 columns of text starting at step, wrapping around at textColumns()
+uint64_t textWindow(const char *text, uint32_t step);
+uint32_t textColumns(const char *text);
+
+#endif // _TEXT_H
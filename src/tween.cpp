@@ -0,0 +1,77 @@
+#include "tween.h"
+
+// Everything here is fixed point: progress and easing are Q8 (0 => start, 256 => end),
+// so each frame costs a couple of table lookups and integer multiplies per color.
+
+static const size_t easingLutSize = 65; // 64 segments, plus the end point
+
+// ref: quadratic in, quadratic out and smoothstep, sampled at t = i / 64
+static const uint16_t easingLut[][easingLutSize] = {
+    // tweenEasingIn
+    {0, 0, 0, 1, 1, 2, 2, 3, 4, 5, 6, 8, 9, 11, 12, 14, 16, 18, 20, 23, 25, 28, 30, 33, 36, 39, 42, 46,
+     49, 53, 56, 60, 64, 68, 72, 77, 81, 86, 90, 95, 100, 105, 110, 116, 121, 127, 132, 138, 144, 150,
+     156, 163, 169, 176, 182, 189, 196, 203, 210, 218, 225, 233, 240, 248, 256},
+    // tweenEasingOut
+    {0, 8, 16, 23, 31, 38, 46, 53, 60, 67, 74, 80, 87, 93, 100, 106, 112, 118, 124, 129, 135, 140, 146,
+     151, 156, 161, 166, 170, 175, 179, 184, 188, 192, 196, 200, 203, 207, 210, 214, 217, 220, 223, 226,
+     228, 231, 233, 236, 238, 240, 242, 244, 245, 247, 248, 250, 251, 252, 253, 254, 254, 255, 255, 256,
+     256, 256},
+    // tweenEasingInOut
+    {0, 0, 1, 2, 3, 4, 6, 9, 11, 14, 17, 20, 24, 27, 31, 36, 40, 45, 49, 54, 59, 65, 70, 75, 81, 87, 92,
+     98, 104, 110, 116, 122, 128, 134, 140, 146, 152, 158, 164, 169, 175, 181, 186, 191, 197, 202, 207,
+     211, 216, 220, 225, 229, 232, 236, 239, 242, 245, 247, 250, 252, 253, 254, 255, 256, 256},
+};
+static const size_t easingLutCount = sizeof(easingLut) / sizeof(easingLut[0]);
+
+static uint32_t ease(uint8_t easing, uint32_t progress)
+{
+  if (progress >= 256)
+    return 256;
+  if (easing == tweenEasingLinear || easing > easingLutCount)
+    return progress;
+
+  // interpolate between the 2 closest samples
+  const uint16_t *const lut = easingLut[easing - 1];
+  const uint32_t index = progress >> 2;
+  const uint32_t fraction = progress & 3;
+  return lut[index] + (((lut[index + 1] - lut[index]) * fraction) >> 2);
+}
+
+static inline uint32_t lerpChannel(uint32_t from, uint32_t to, int shift, uint32_t eased)
+{
+  const int32_t start = (from >> shift) & 0xff;
+  const int32_t end = (to >> shift) & 0xff;
+  return (uint32_t)(start + (((end - start) * (int32_t)eased) >> 8)) << shift;
+}
+
+uint32_t tweenLerpColor(uint32_t from, uint32_t to, uint32_t progress)
+{
+  return lerpChannel(from, to, 16, progress) | lerpChannel(from, to, 8, progress) |
+         lerpChannel(from, to, 0, progress);
+}
+
+uint32_t tweenColorAt(const LightUnit &lightUnit, uint32_t now)
+{
+  const LightUnitAnimation &animation = lightUnit.animation;
+  const uint32_t duration = animation.tweenMs;
+  const uint32_t elapsed = now - lightUnit.state.tweenStartMs;
+  const uint32_t cycle = elapsed / duration;
+  uint32_t position = elapsed % duration;
+
+  switch (animation.tweenLoop)
+  {
+  case tweenLoopRestart:
+    break;
+  case tweenLoopPingPong:
+    if (cycle & 1)
+      position = duration - position;
+    break;
+  default: // tweenLoopOnce
+    if (cycle)
+      return animation.tweenColor;
+  }
+
+  // progress in Q8. Note: tweenMs is capped at tweenMaxMs, so this cannot overflow
+  const uint32_t eased = ease(animation.tweenEasing, (position << 8) / duration);
+  return tweenLerpColor(lightUnit.color, animation.tweenColor, eased);
+}
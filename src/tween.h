@@ -0,0 +1,18 @@
+#ifndef _TWEEN_H
+
+#define _TWEEN_H
+
+#include "lightUnit.h"
+
+#include <stddef.h>
+
+// longest fade supported (about 4.6 hours), so progress fits in fixed point math
+static const uint32_t tweenMaxMs = 0x00ffffffUL;
+
+// color of a tweening unit at a given time, interpolated between color and tweenColor
+uint32_t tweenColorAt(const LightUnit &lightUnit, uint32_t now);
+
+// color between from and to, where progress is Q8 (0 => from, 256 => to)
+uint32_t tweenLerpColor(uint32_t from, uint32_t to, uint32_t progress);
+
+#endif // _TWEEN_H
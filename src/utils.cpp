@@ -1,5 +1,9 @@
 #include "common.h"
+#include "wifiConfig.h"
+
 #include <Esp.h>
+#include <Preferences.h>
+#include <algorithm>
 
 // Ref: https://github.com/arduino/ArduinoCore-avr/issues/251
 #ifndef bitSet64
@@ -68,6 +72,78 @@ bool flipFlag(uint64_t &currFlags, int flagBit)
   return currBit ? clearFlag(currFlags, flagBit) : setFlag(currFlags, flagBit);
 }
 
+void latencyStatsAdd(LatencyStats &stats, uint32_t sample)
+{
+  stats.samples[stats.count % latencyStatsWindow] = sample;
+  ++stats.count;
+}
+
+uint32_t latencyStatsPercentile(const LatencyStats &stats, uint32_t percentile)
+{
+  const size_t samplesSize = std::min((size_t)stats.count, latencyStatsWindow);
+  if (samplesSize == 0)
+    return 0;
+
+  // Note: window is small, so sorting a copy on every call is cheap enough
+  uint32_t sorted[latencyStatsWindow];
+  memcpy(sorted, stats.samples, samplesSize * sizeof(sorted[0]));
+  std::sort(sorted, sorted + samplesSize);
+  const size_t index = std::min((samplesSize * percentile) / 100, samplesSize - 1);
+  return sorted[index];
+}
+
+// ref: http://www.isthe.com/chongo/tech/comp/fnv/
+uint32_t nvWearHash(const uint8_t *blob, size_t blobSize)
+{
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < blobSize; ++i)
+  {
+    hash ^= blob[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+bool nvWearSaveIsDue(NvWear &wear)
+{
+  if (wear.savedMillisValid && millis() - wear.savedMillis < nvWearMinSaveIntervalMs)
+  {
+#ifdef DEBUG
+    Serial.printf("Saving %s deferred: last save was too recent\n", wear.key);
+#endif
+    wear.saveIsPending = true;
+    return false;
+  }
+  return true;
+}
+
+bool nvWearPutBytes(NvWear &wear, const uint8_t *blob, size_t blobSize)
+{
+  const uint32_t hash = nvWearHash(blob, blobSize);
+  wear.saveIsPending = false;
+  if (hash == wear.savedHash)
+  {
+#ifdef DEBUG
+    Serial.printf("Saving %s skipped: no changes\n", wear.key);
+#endif
+    return false;
+  }
+
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  const size_t written = preferences.putBytes(wear.key, blob, blobSize);
+  preferences.end();
+
+  wear.savedMillis = millis();
+  wear.savedMillisValid = true;
+  if (written == blobSize)
+    wear.savedHash = hash;
+#ifdef DEBUG
+  Serial.printf("Saved %s: %zu of %zu bytes\n", wear.key, written, blobSize);
+#endif
+  return written == blobSize;
+}
+
 void parseOnOffToggle(const char *subName, const char *message,
                       OnOffToggle onPtr, OnOffToggle offPtr, OnOffToggle togglePtr)
 {
@@ -0,0 +1,381 @@
+#include "vm.h"
+#include "bitboard.h"
+#include "common.h"
+#include "prng.h"
+#include "wifiConfig.h"
+
+#include <Preferences.h>
+
+// Programs are uploaded over mqtt, so the interpreter trusts nothing about them: every
+// stack access, jump and variable index is checked, and a frame stops after vmFrameBudget
+// ops. A program that misbehaves just leaves pixelMask and color alone for that frame.
+
+static const char *const ATTR_PROGRAM = "program";   // + slot: the code of that slot, size bytes of it
+static const char *const ATTR_PROGRAMS = "programs"; // every slot, whole: how they used to be saved
+static const size_t vmVarsCount = sizeof(((LightUnitState *)nullptr)->kindVars) / sizeof(uint64_t);
+
+typedef struct VmProgram_t
+{
+  uint8_t size;
+  uint8_t code[vmProgramSize];
+} VmProgram;
+
+static VmProgram programs[vmProgramsMax];
+
+static void programKey(uint8_t slot, char *key, size_t keySize)
+{
+  snprintf(key, keySize, "%s%u", ATTR_PROGRAM, (unsigned int)slot);
+}
+
+static void saveProgram(Preferences &preferences, uint8_t slot)
+{
+  char key[16];
+  programKey(slot, key, sizeof(key));
+  const VmProgram &program = programs[slot];
+  if (program.size == 0)
+    preferences.remove(key);
+  else
+    preferences.putBytes(key, program.code, program.size);
+}
+
+static bool readProgram(Preferences &preferences, uint8_t slot)
+{
+  char key[16];
+  programKey(slot, key, sizeof(key));
+  VmProgram &program = programs[slot];
+  const size_t size = preferences.getBytesLength(key);
+  if (size == 0)
+    return true; // empty slot
+  if (size > vmProgramSize || preferences.getBytes(key, program.code, sizeof(program.code)) != size)
+    return false;
+  program.size = (uint8_t)size;
+  return true;
+}
+
+void initPrograms()
+{
+  memset(programs, 0, sizeof(programs));
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+
+  // Note: the old blob is moved to a key per slot, once
+  const bool isOldBlob = preferences.getBytesLength(ATTR_PROGRAMS) == sizeof(programs) &&
+                         preferences.getBytes(ATTR_PROGRAMS, programs, sizeof(programs)) == sizeof(programs);
+  for (uint8_t slot = 0; slot < vmProgramsMax; ++slot)
+  {
+    VmProgram &program = programs[slot];
+    const bool isValid = isOldBlob ? program.size <= vmProgramSize : readProgram(preferences, slot);
+    if (!isValid)
+    {
+#ifdef DEBUG
+      Serial.printf("Dropping program %u: it does not fit in %zu bytes\n", slot, vmProgramSize);
+#endif
+      memset(&program, 0, sizeof(program));
+    }
+    if (isOldBlob)
+      saveProgram(preferences, slot);
+  }
+  if (isOldBlob)
+    preferences.remove(ATTR_PROGRAMS);
+  preferences.end();
+}
+
+// Note: only the slot's own key is written, with the bytes it uses
+bool vmProgramSet(uint8_t slot, size_t at, const uint8_t *code, size_t codeSize)
+{
+  if (slot >= vmProgramsMax || at + codeSize > vmProgramSize)
+    return false;
+
+  VmProgram &program = programs[slot];
+  if (at == 0)
+    memset(&program, 0, sizeof(program));
+  memcpy(&program.code[at], code, codeSize);
+  if (at + codeSize > program.size)
+    program.size = (uint8_t)(at + codeSize);
+
+  Preferences preferences;
+  preferences.begin(PREFERENCES_NAME /*name*/, false /*readOnly*/);
+  saveProgram(preferences, slot);
+  preferences.end();
+  return true;
+}
+
+#define VM_POP(VAR)     \
+  if (sp == 0)          \
+    return false;       \
+  const uint64_t VAR = stack[--sp]
+#define VM_PUSH(VALUE)       \
+  if (sp == vmStackSize)     \
+    return false;            \
+  stack[sp++] = (VALUE)
+#define VM_IMM8(VAR)          \
+  if (pc >= program.size)     \
+    return false;             \
+  const uint8_t VAR = program.code[pc++]
+
+static bool vmExecute(const VmProgram &program, LightUnit &unit, uint64_t &pixels, uint32_t &ops)
+{
+  uint64_t stack[vmStackSize];
+  size_t sp = 0;
+  size_t pc = 0;
+  uint64_t *const vars = unit.state.kindVars;
+
+  for (ops = 0; ops < vmFrameBudget; ++ops)
+  {
+    if (pc >= program.size)
+      return true; // ran off the end: same as vmOpEnd
+
+    switch (program.code[pc++])
+    {
+    case vmOpEnd:
+      return true;
+    case vmOpPush8:
+    {
+      VM_IMM8(value);
+      VM_PUSH(value);
+      break;
+    }
+    case vmOpPush32:
+    {
+      if (pc + 4 > program.size)
+        return false;
+      uint32_t value = 0;
+      for (int i = 3; i >= 0; --i)
+        value = (value << 8) | program.code[pc + i];
+      pc += 4;
+      VM_PUSH(value);
+      break;
+    }
+    case vmOpDup:
+    {
+      VM_POP(a);
+      VM_PUSH(a);
+      VM_PUSH(a);
+      break;
+    }
+    case vmOpDrop:
+    {
+      VM_POP(a);
+      (void)a;
+      break;
+    }
+    case vmOpSwap:
+    {
+      VM_POP(b);
+      VM_POP(a);
+      VM_PUSH(b);
+      VM_PUSH(a);
+      break;
+    }
+    case vmOpOver:
+    {
+      VM_POP(b);
+      VM_POP(a);
+      VM_PUSH(a);
+      VM_PUSH(b);
+      VM_PUSH(a);
+      break;
+    }
+    case vmOpAdd:
+    case vmOpSub:
+    case vmOpMul:
+    case vmOpDiv:
+    case vmOpMod:
+    case vmOpAnd:
+    case vmOpOr:
+    case vmOpXor:
+    case vmOpShl:
+    case vmOpShr:
+    case vmOpEq:
+    case vmOpLt:
+    case vmOpGt:
+    {
+      const uint8_t op = program.code[pc - 1];
+      VM_POP(b);
+      VM_POP(a);
+      uint64_t result;
+      switch (op)
+      {
+      case vmOpAdd: result = a + b; break;
+      case vmOpSub: result = a - b; break;
+      case vmOpMul: result = a * b; break;
+      case vmOpDiv: result = b ? a / b : 0; break;
+      case vmOpMod: result = b ? a % b : 0; break;
+      case vmOpAnd: result = a & b; break;
+      case vmOpOr: result = a | b; break;
+      case vmOpXor: result = a ^ b; break;
+      case vmOpShl: result = b < 64 ? a << b : 0; break;
+      case vmOpShr: result = b < 64 ? a >> b : 0; break;
+      case vmOpEq: result = a == b; break;
+      case vmOpLt: result = a < b; break;
+      default: result = a > b; break;
+      }
+      VM_PUSH(result);
+      break;
+    }
+    case vmOpNot:
+    {
+      VM_POP(a);
+      VM_PUSH(~a);
+      break;
+    }
+    case vmOpJmp:
+    case vmOpJz:
+    {
+      const uint8_t op = program.code[pc - 1];
+      VM_IMM8(offset);
+      bool jump = true;
+      if (op == vmOpJz)
+      {
+        VM_POP(a);
+        jump = a == 0;
+      }
+      if (jump)
+      {
+        const int target = (int)pc + (int8_t)offset;
+        if (target < 0 || target > (int)program.size)
+          return false;
+        pc = (size_t)target;
+      }
+      break;
+    }
+    case vmOpLoad:
+    {
+      VM_IMM8(var);
+      if (var >= vmVarsCount)
+        return false;
+      VM_PUSH(vars[var]);
+      break;
+    }
+    case vmOpStore:
+    {
+      VM_IMM8(var);
+      VM_POP(a);
+      if (var >= vmVarsCount)
+        return false;
+      vars[var] = a;
+      break;
+    }
+    case vmOpMask:
+    {
+      VM_PUSH(pixels);
+      break;
+    }
+    case vmOpSetMask:
+    {
+      VM_POP(a);
+      pixels = a;
+      break;
+    }
+    case vmOpBit:
+    {
+      VM_POP(a);
+      VM_PUSH(bitboardBit(a & 63));
+      break;
+    }
+    case vmOpCount:
+    {
+      VM_POP(a);
+      VM_PUSH((uint64_t)bitboardCount(a));
+      break;
+    }
+    case vmOpEast:
+    {
+      VM_POP(a);
+      VM_PUSH(bitboardScrollEast(a));
+      break;
+    }
+    case vmOpWest:
+    {
+      VM_POP(a);
+      VM_PUSH(bitboardScrollWest(a));
+      break;
+    }
+    case vmOpNorth:
+    {
+      VM_POP(a);
+      VM_PUSH(bitboardScrollNorth(a));
+      break;
+    }
+    case vmOpSouth:
+    {
+      VM_POP(a);
+      VM_PUSH(bitboardScrollSouth(a));
+      break;
+    }
+    case vmOpColor:
+    {
+      VM_PUSH(unit.color);
+      break;
+    }
+    case vmOpSetColor:
+    {
+      VM_POP(a);
+      unit.color = (uint32_t)a & 0x00ffffff;
+      break;
+    }
+    case vmOpRgb:
+    {
+      VM_POP(b);
+      VM_POP(g);
+      VM_POP(r);
+      VM_PUSH(((r & 0xff) << 16) | ((g & 0xff) << 8) | (b & 0xff));
+      break;
+    }
+    case vmOpWheel:
+    {
+      VM_POP(a);
+      VM_PUSH(lightsWheel((uint8_t)a));
+      break;
+    }
+    case vmOpMillis:
+    {
+      VM_PUSH(lightsClockMs());
+      break;
+    }
+    case vmOpFrame:
+    {
+      VM_PUSH(unit.state.kindStep);
+      break;
+    }
+    case vmOpRand:
+    {
+      VM_POP(a);
+      VM_PUSH(a ? prngNext(unit.state.rng) % a : 0);
+      break;
+    }
+    case vmOpRandMask:
+    {
+      VM_PUSH(prngNext(unit.state.rng));
+      break;
+    }
+    default:
+      return false; // bad op
+    }
+  }
+  return false; // over budget
+}
+
+bool vmRun(LightUnit &unit, uint64_t &pixels)
+{
+  const uint8_t slot = unit.payload.program;
+  if (slot >= vmProgramsMax || programs[slot].size == 0)
+    return false;
+
+  uint32_t ops = 0;
+  uint64_t newPixels = pixels;
+  const uint32_t origColor = unit.color;
+  const bool ok = vmExecute(programs[slot], unit, newPixels, ops);
+  ++unit.state.kindStep;
+  if (!ok)
+  {
+    unit.color = origColor;
+#ifdef DEBUG
+    Serial.printf("Program %u of LightUnit %d aborted after %" PRIu32 " ops\n",
+                  slot, (int)unit.id, ops);
+#endif
+    return false;
+  }
+  pixels = newPixels;
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef _VM_H
+
+#define _VM_H
+
+#include "lightUnit.h"
+
+static const size_t vmProgramsMax = 8;
+static const size_t vmProgramSize = 96;
+static const size_t vmStackSize = 16;
+static const uint32_t vmFrameBudget = 256; // max ops run on each frame
+
+// Programs are bytecode for a small stack machine. Every value is 64 bits, so a whole
+// pixelMask fits in a stack slot. Ops that take an immediate are followed by it, in
+// little endian. Jumps are relative to the op after them.
+typedef enum VmOp_t
+{
+  vmOpEnd = 0x00,      // done with this frame
+  vmOpPush8 = 0x01,    // imm8  => push it
+  vmOpPush32 = 0x02,   // imm32 => push it
+  vmOpDup = 0x03,      // a => a a
+  vmOpDrop = 0x04,     // a =>
+  vmOpSwap = 0x05,     // a b => b a
+  vmOpOver = 0x06,     // a b => a b a
+  vmOpAdd = 0x07,      // a b => a + b
+  vmOpSub = 0x08,      // a b => a - b
+  vmOpMul = 0x09,      // a b => a * b
+  vmOpDiv = 0x0a,      // a b => a / b (0 if b is 0)
+  vmOpMod = 0x0b,      // a b => a % b (0 if b is 0)
+  vmOpAnd = 0x0c,      // a b => a & b
+  vmOpOr = 0x0d,       // a b => a | b
+  vmOpXor = 0x0e,      // a b => a ^ b
+  vmOpNot = 0x0f,      // a => ~a
+  vmOpShl = 0x10,      // a b => a << b
+  vmOpShr = 0x11,      // a b => a >> b
+  vmOpEq = 0x12,       // a b => a == b
+  vmOpLt = 0x13,       // a b => a < b
+  vmOpGt = 0x14,       // a b => a > b
+  vmOpJmp = 0x15,      // rel8 => jump
+  vmOpJz = 0x16,       // rel8, a => jump if a is 0
+  vmOpLoad = 0x17,     // imm8 => push unit variable (0..3). Variables start at 0 when unit is set
+  vmOpStore = 0x18,    // imm8, a => set unit variable
+  vmOpMask = 0x19,     // => pixelMask
+  vmOpSetMask = 0x1a,  // a => pixelMask = a
+  vmOpBit = 0x1b,      // a => 1 << a (pixel a)
+  vmOpCount = 0x1c,    // a => number of bits set in a
+  vmOpEast = 0x1d,     // a => a scrolled right, wrapping around
+  vmOpWest = 0x1e,     // a => a scrolled left, wrapping around
+  vmOpNorth = 0x1f,    // a => a scrolled up, wrapping around
+  vmOpSouth = 0x20,    // a => a scrolled down, wrapping around
+  vmOpColor = 0x21,    // => color
+  vmOpSetColor = 0x22, // a => color = a
+  vmOpRgb = 0x23,      // r g b => color
+  vmOpWheel = 0x24,    // a => rainbow color at position a (0..255)
+  vmOpMillis = 0x25,   // => ms of animation time (see lightsClockMs)
+  vmOpFrame = 0x26,    // => frames run since unit was set
+  vmOpRand = 0x27,     // a => random number in [0, a)
+  vmOpRandMask = 0x28, // => random 64 bit mask
+} VmOp;
+
+void initPrograms();
+bool vmProgramSet(uint8_t slot, size_t at, const uint8_t *code, size_t codeSize); // at 0 starts over
+
+// runs unit's program for one frame, updating color and pixels. False if program was aborted
+bool vmRun(LightUnit &unit, uint64_t &pixels);
+
+#endif // _VM_H
@@ -12,7 +12,6 @@
 //#define DEFAULT_WIFIMANAGER_PORTAL_MASK IPAddress(255,255,255,0)
 #define ESP_BOARD_LED 13 // https://learn.adafruit.com/adafruit-huzzah32-esp32-feather?view=all#pinouts
 static const size_t _ATTR_MAX_LEN = 40;
-static const char *const PREFERENCES_NAME = "myPrefs";
 
 static const char *const ATTR_WIFI_SSID = "wifi_ssid";
 static const char *const ATTR_WIFI_PASS = "wifi_pass";
@@ -7,6 +7,10 @@
 #define DEFAULT_MQTT_TOPIC "/trelliswifi/"
 #define DEFAULT_MQTT_PORT "1883"
 
+// Namespace used for all non-volatile storage (nvs) of this project. Note
+// that a factory reset erases everything in it.
+#define PREFERENCES_NAME "myPrefs"
+
 // Define this in order to force clear setting upon call
 // to wifiConfig_init(). The value should be a valid GPIO
 // number, which will be set at input. If it reads as HIGH
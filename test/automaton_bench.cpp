@@ -0,0 +1,144 @@
+#include "check.h"
+#include <Arduino.h>
+#include "../src/automaton.h"
+#include "../src/bitboard.h"
+#include "../src/prng.h"
+
+// Generations per second of automatonStep and automatonNext, next to a cell by cell
+// stepper that is also the reference their boards are checked against.
+
+static const uint32_t benchGenerations = 2000000;
+
+static uint64_t referenceStep(uint64_t board, uint16_t birth, uint16_t survive, bool wrap)
+{
+  uint64_t result = 0;
+  for (int i = 0; i < 64; ++i)
+  {
+    int neighbors = 0;
+    for (int dy = -1; dy <= 1; ++dy)
+      for (int dx = -1; dx <= 1; ++dx)
+      {
+        int x = bitboardX(i) + dx;
+        int y = bitboardY(i) + dy;
+        if (wrap)
+        {
+          x &= 7;
+          y &= 7;
+        }
+        else if (x < 0 || x > 7 || y < 0 || y > 7)
+          continue;
+        if ((dx || dy) && (board & bitboardBit(y * 8 + x)))
+          ++neighbors;
+      }
+    const uint16_t counts = (board & bitboardBit(i)) ? survive : birth;
+    if (counts & (1 << neighbors))
+      result |= bitboardBit(i);
+  }
+  return result;
+}
+
+static void checkRules()
+{
+  LightUnitAutomaton automaton = {0};
+  CHECK(automatonParseRule("B3/S23", automaton));
+  CHECK(automaton.birth == 1 << 3 && automaton.survive == ((1 << 2) | (1 << 3)) && !automaton.wrap);
+  CHECK(automatonParseRule("b36/s23:t", automaton) && automaton.wrap);
+  CHECK(automaton.birth == ((1 << 3) | (1 << 6)));
+  CHECK(!automatonParseRule("B3S23", automaton));
+  CHECK(!automatonParseRule("B9/S23", automaton));
+  CHECK(!automatonParseRule("B3/S23:x", automaton));
+
+  // every cell, both edge modes, against the reference
+  const char *const rules[] = {"B3/S23", "B36/S23:T", "B2/S", "B1357/S1357:T", "B012345678/S012345678"};
+  uint64_t rng = prngSeed(38);
+  for (const char *rule : rules)
+  {
+    CHECK(automatonParseRule(rule, automaton));
+    for (int i = 0; i < 1000; ++i)
+    {
+      const uint64_t board = prngNext(rng) & prngNext(rng);
+      const uint64_t next = automatonStep(board, automaton.birth, automaton.survive, automaton.wrap);
+      if (next != referenceStep(board, automaton.birth, automaton.survive, automaton.wrap))
+      {
+        printf("%s: 0x%" PRIx64 " => 0x%" PRIx64 "\n", rule, board, next);
+        ++checkFailures;
+        break;
+      }
+    }
+  }
+
+  // a glider on a wrapping board is back, one cell down and right, every 4 generations
+  CHECK(automatonParseRule("B3/S23:T", automaton));
+  const uint64_t glider = bitboardBit(1) | bitboardBit(10) | bitboardBit(16) | bitboardBit(17) | bitboardBit(18);
+  uint64_t board = glider;
+  for (int generation = 0; generation < 32; ++generation)
+    board = automatonStep(board, automaton.birth, automaton.survive, automaton.wrap);
+  CHECK(board == glider);
+  for (int generation = 0; generation < 4; ++generation)
+    board = automatonStep(board, automaton.birth, automaton.survive, automaton.wrap);
+  CHECK(board == bitboardSouth(bitboardEast(glider)));
+
+  // a blinker is stagnant: automatonNext seeds the unit again instead of repeating it
+  LightUnit unit = {0};
+  CHECK(automatonParseRule("B3/S23", unit.payload.automaton));
+  unit.state.rng = prngSeed(1);
+  unit.pixelMask = bitboardBit(17) | bitboardBit(18) | bitboardBit(19);
+  unit.pixelMask = automatonNext(unit);
+  CHECK(unit.pixelMask == (bitboardBit(10) | bitboardBit(18) | bitboardBit(26)));
+  unit.pixelMask = automatonNext(unit);
+  CHECK(unit.pixelMask != (bitboardBit(17) | bitboardBit(18) | bitboardBit(19)) && unit.state.kindStep == 0);
+}
+
+typedef uint64_t(StepFunction)(uint64_t board, uint16_t birth, uint16_t survive, bool wrap);
+
+static void benchStep(const char *name, StepFunction *step, const char *rule, uint32_t generations)
+{
+  LightUnitAutomaton automaton = {0};
+  automatonParseRule(rule, automaton);
+  uint64_t board = prngSeed(38);
+  const unsigned long startUs = micros();
+  for (uint32_t generation = 0; generation < generations; ++generation)
+  {
+    board = step(board, automaton.birth, automaton.survive, automaton.wrap);
+    if (!board)
+      board = prngSeed(generation);
+  }
+  const unsigned long elapsedUs = micros() - startUs;
+  printf("%-18s %-10s %12.0f %10.1f\n", name, rule, generations * 1e6 / (elapsedUs ? elapsedUs : 1),
+         elapsedUs * 1000.0 / generations);
+  volatile uint64_t sink = board;
+  (void)sink;
+}
+
+static void benchNext(const char *rule)
+{
+  LightUnit unit = {0};
+  automatonParseRule(rule, unit.payload.automaton);
+  unit.state.rng = prngSeed(38);
+  unit.pixelMask = prngNext(unit.state.rng);
+  uint32_t reseeds = 0;
+  const unsigned long startUs = micros();
+  for (uint32_t generation = 0; generation < benchGenerations; ++generation)
+  {
+    unit.pixelMask = automatonNext(unit);
+    reseeds += unit.state.kindStep == 0;
+  }
+  const unsigned long elapsedUs = micros() - startUs;
+  printf("%-18s %-10s %12.0f %10.1f   (%" PRIu32 " reseeds)\n", "automatonNext", rule,
+         benchGenerations * 1e6 / (elapsedUs ? elapsedUs : 1), elapsedUs * 1000.0 / benchGenerations,
+         reseeds);
+}
+
+int main()
+{
+  checkRules();
+  printf("%-18s %-10s %12s %10s\n", "step", "rule", "gens/s", "ns/gen");
+  benchStep("automatonStep", automatonStep, "B3/S23", benchGenerations);
+  benchStep("automatonStep", automatonStep, "B3/S23:T", benchGenerations);
+  benchStep("automatonStep", automatonStep, "B36/S23:T", benchGenerations);
+  benchStep("cell by cell", referenceStep, "B3/S23:T", benchGenerations / 20);
+  benchNext("B3/S23");
+  benchNext("B3/S23:T");
+  printf("automaton_bench: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
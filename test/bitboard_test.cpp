@@ -0,0 +1,59 @@
+#include "check.h"
+#include "../src/bitboard.h"
+
+// Scrolls, mirrors and rotations behind the pixelMask transforms. Bit 0 is button 1, at
+// the top left corner; rotations are clockwise.
+
+static void testScrolls()
+{
+  CHECK(bitboardScrollEast(bitboardColumn7) == bitboardColumn0);
+  CHECK(bitboardScrollWest(bitboardColumn0) == bitboardColumn7);
+  CHECK(bitboardScrollNorth(0xffULL) == 0xffULL << 56);
+  CHECK(bitboardScrollSouth(0xffULL << 56) == 0xffULL);
+
+  // 8 scrolls any way bring the board back
+  const uint64_t board = 0x0123456789abcdefULL;
+  uint64_t east = board;
+  uint64_t south = board;
+  for (int i = 0; i < 8; ++i)
+  {
+    east = bitboardScrollEast(east);
+    south = bitboardScrollSouth(south);
+  }
+  CHECK(east == board && south == board);
+  CHECK(bitboardScrollWest(bitboardScrollEast(board)) == board);
+  CHECK(bitboardScrollNorth(bitboardScrollSouth(board)) == board);
+}
+
+static void testRotations()
+{
+  CHECK(bitboardRotate90(bitboardBit(0)) == bitboardBit(7));
+  CHECK(bitboardRotate180(bitboardBit(0)) == bitboardBit(63));
+  CHECK(bitboardRotate270(bitboardBit(0)) == bitboardBit(56));
+  CHECK(bitboardTranspose(bitboardBit(1)) == bitboardBit(8));
+  CHECK(bitboardFlipVertical(bitboardBit(0)) == bitboardBit(56));
+  CHECK(bitboardFlipHorizontal(bitboardBit(0)) == bitboardBit(7));
+
+  const uint64_t board = 0x0123456789abcdefULL;
+  CHECK(bitboardFlipHorizontal(bitboardFlipVertical(board)) == bitboardRotate180(board));
+  CHECK(bitboardRotate90(bitboardRotate90(board)) == bitboardRotate180(board));
+  CHECK(bitboardRotate90(bitboardRotate270(board)) == board);
+  CHECK(bitboardTranspose(bitboardTranspose(board)) == board);
+
+  // every bit goes where x and y say it should
+  for (int i = 0; i < 64; ++i)
+  {
+    const int x = bitboardX(i);
+    const int y = bitboardY(i);
+    CHECK(bitboardRotate90(bitboardBit(i)) == bitboardBit(x * 8 + (7 - y)));
+    CHECK(bitboardTranspose(bitboardBit(i)) == bitboardBit(x * 8 + y));
+  }
+}
+
+int main()
+{
+  testScrolls();
+  testRotations();
+  printf("bitboard_test: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
@@ -0,0 +1,137 @@
+#include "check.h"
+#include "../src/common.h"
+#include "../src/gestures.h"
+#include "tickerScheduler.h"
+
+#include <Preferences.h>
+#include <string.h>
+
+// Gestures go to nvs field by field, within the wear limits scenes use, and come back on boot.
+// What a gesture runs is how the test tells which gestures are there.
+
+static std::string ran;
+bool runCmdOp(const char *op)
+{
+  ran = op;
+  return true;
+}
+void nvClearRequest() { ran = "nvClear"; }
+
+static const size_t headerSize = 4;
+static const size_t stepSize = 8 + 8;
+
+static Gesture makeGesture(const char *action, uint64_t longPressed, uint64_t pressed2 = 0)
+{
+  Gesture gesture = Gesture();
+  gesture.stepsCount = pressed2 ? 2 : 1;
+  gesture.steps[0].longPressed = longPressed;
+  gesture.steps[1].pressed = pressed2;
+  strncpy(gesture.action, action, sizeof(gesture.action) - 1);
+  return gesture;
+}
+
+// action run by the button reports, or empty if none
+static std::string runs(uint64_t longPressed, uint64_t pressed2 = 0)
+{
+  ran.clear();
+  hostMillis += 20 * 1000; // past the step timeout of whatever came before
+  localButtonProcess(0, longPressed);
+  if (pressed2)
+    localButtonProcess(pressed2, 0);
+  return ran;
+}
+
+static std::vector<uint8_t> savedBlob()
+{
+  Preferences preferences;
+  std::vector<uint8_t> blob(preferences.getBytesLength("gestures"));
+  if (!blob.empty())
+    preferences.getBytes("gestures", blob.data(), blob.size());
+  return blob;
+}
+
+static void boot()
+{
+  TickerScheduler ts;
+  initGestures(ts);
+}
+
+static void testSaveAndLoad(TickerScheduler &ts)
+{
+  CHECK(savedBlob().empty() && runs(0x80) == "flashlight");
+
+  // first save goes out right away, with only the steps and action bytes the gestures use
+  CHECK(gestureSet(makeGesture("scan", 1ULL << 20, 1ULL << 21)));
+  const std::vector<uint8_t> first = savedBlob();
+  CHECK(first.size() > headerSize && first[2] == 2 /*version*/);
+  CHECK(first.size() >= 1 + 2 * stepSize + 1 + 4 &&
+        memcmp(&first[first.size() - 4], "scan", 4) == 0 && first[first.size() - 5] == 4);
+
+  // too soon for another one: it waits for the minute tick that is past the interval
+  CHECK(gestureSet(makeGesture("crazy", 1ULL << 30)));
+  CHECK(savedBlob() == first);
+  ts.run(60 * 1000);
+  CHECK(savedBlob() == first);
+  hostMillis += 60 * 1000;
+  ts.run(60 * 1000);
+  CHECK(savedBlob().size() == first.size() + 1 + stepSize + 1 + 5);
+
+  // what was not saved yet is lost on boot, the rest comes back
+  CHECK(gestureSet(makeGesture("counter1", 1ULL << 40)));
+  boot();
+  CHECK(runs(1ULL << 20, 1ULL << 21) == "scan");
+  CHECK(runs(1ULL << 30) == "crazy");
+  CHECK(runs(1ULL << 40).empty());
+  CHECK(runs(0x80) == "flashlight");
+}
+
+static void testBogusBlob()
+{
+  const std::vector<uint8_t> blob = savedBlob();
+  Preferences preferences;
+
+  // each one falls back to the default gestures
+  std::vector<uint8_t> bogus(blob.begin(), blob.end() - 1);
+  preferences.putBytes("gestures", bogus.data(), bogus.size());
+  boot();
+  CHECK(runs(1ULL << 30).empty() && runs(0x80) == "flashlight");
+
+  bogus = blob;
+  bogus[2] = 1; // version that saved whole structs
+  preferences.putBytes("gestures", bogus.data(), bogus.size());
+  boot();
+  CHECK(runs(1ULL << 30).empty());
+
+  bogus = blob;
+  bogus[headerSize] = gestureMaxSteps + 1; // steps of the first gesture
+  preferences.putBytes("gestures", bogus.data(), bogus.size());
+  boot();
+  CHECK(runs(1ULL << 30).empty());
+
+  bogus = blob;
+  bogus[blob.size() - 6] = gestureActionSize; // action of the last gesture
+  preferences.putBytes("gestures", bogus.data(), bogus.size());
+  boot();
+  CHECK(runs(1ULL << 30).empty());
+
+  preferences.putBytes("gestures", blob.data(), blob.size());
+  boot();
+  CHECK(runs(1ULL << 30) == "crazy");
+
+  // reset: defaults, and the next change is saved even if it matches what was there before
+  gesturesReset();
+  CHECK(savedBlob().empty() && runs(1ULL << 30).empty());
+  hostMillis += 60 * 1000;
+  CHECK(gestureSet(makeGesture("crazy", 1ULL << 30)));
+  CHECK(!savedBlob().empty());
+}
+
+int main()
+{
+  TickerScheduler ts;
+  initGestures(ts);
+  testSaveAndLoad(ts);
+  testBogusBlob();
+  printf("gestures_test: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
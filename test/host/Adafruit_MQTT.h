@@ -0,0 +1,68 @@
+#ifndef _HOST_ADAFRUIT_MQTT_H
+
+#define _HOST_ADAFRUIT_MQTT_H
+
+#include <Arduino.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// A fake broker stands in for the connection: publishes land in hostPublished, with the time
+// they went out, and subscriptions read from hostIncoming. Limits are the library defaults on esp32.
+
+#define MAXBUFFERSIZE 150
+#define SUBSCRIPTIONDATALEN 100
+
+typedef struct
+{
+  std::string topic;
+  std::string payload;
+  uint32_t ms; // hostMillis when published
+} HostMqttMsg;
+
+extern std::vector<HostMqttMsg> hostPublished;
+extern std::deque<HostMqttMsg> hostIncoming;
+extern bool hostMqttUp;          // broker takes connections
+extern int hostMqttPublishFails; // this many publishes fail, as if the connection broke
+
+class Adafruit_MQTT;
+
+class Adafruit_MQTT_Subscribe
+{
+public:
+  Adafruit_MQTT_Subscribe(Adafruit_MQTT *mqtt, const char *topic, uint8_t qos = 0) : topic(topic) {}
+  const char *topic;
+  uint8_t lastread[SUBSCRIPTIONDATALEN];
+  uint16_t datalen = 0;
+};
+
+class Adafruit_MQTT_Publish
+{
+public:
+  Adafruit_MQTT_Publish(Adafruit_MQTT *mqtt, const char *topic, uint8_t qos = 0) : mqtt(mqtt), topic(topic) {}
+  bool publish(const char *payload);
+  bool publish(uint8_t *payload, uint16_t len);
+
+private:
+  Adafruit_MQTT *mqtt;
+  const char *topic;
+};
+
+class Adafruit_MQTT
+{
+public:
+  bool connected() { return isConnected; }
+  int8_t connect();
+  bool disconnect();
+  bool subscribe(Adafruit_MQTT_Subscribe *sub);
+  Adafruit_MQTT_Subscribe *readSubscription(int16_t timeout = 0);
+  const char *connectErrorString(int8_t code) { return "broker is down"; }
+
+private:
+  friend class Adafruit_MQTT_Publish;
+  bool isConnected = false;
+  std::vector<Adafruit_MQTT_Subscribe *> subscriptions;
+};
+
+#endif // _HOST_ADAFRUIT_MQTT_H
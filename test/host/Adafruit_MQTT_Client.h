@@ -0,0 +1,15 @@
+#ifndef _HOST_ADAFRUIT_MQTT_CLIENT_H
+
+#define _HOST_ADAFRUIT_MQTT_CLIENT_H
+
+#include <Adafruit_MQTT.h>
+#include <WiFi.h>
+
+class Adafruit_MQTT_Client : public Adafruit_MQTT
+{
+public:
+  Adafruit_MQTT_Client(WiFiClient *client, const char *server, uint16_t port, const char *user,
+                       const char *pass) {}
+};
+
+#endif // _HOST_ADAFRUIT_MQTT_CLIENT_H
@@ -0,0 +1,26 @@
+#ifndef _HOST_ADAFRUIT_NEOTRELLIS_H
+
+#define _HOST_ADAFRUIT_NEOTRELLIS_H
+
+#include <Arduino.h>
+
+// Key events only: tests call keyPressCallback the way trellis.read() does
+
+#define SEESAW_KEYPAD_EDGE_HIGH 0
+#define SEESAW_KEYPAD_EDGE_LOW 1
+#define SEESAW_KEYPAD_EDGE_FALLING 2
+#define SEESAW_KEYPAD_EDGE_RISING 3
+
+union keyEvent
+{
+  struct
+  {
+    uint16_t EDGE : 2;
+    uint16_t NUM : 14;
+  } bit;
+  uint16_t reg;
+};
+
+typedef void *TrellisCallback;
+
+#endif // _HOST_ADAFRUIT_NEOTRELLIS_H
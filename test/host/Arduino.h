@@ -0,0 +1,75 @@
+#ifndef _HOST_ARDUINO_H
+
+#define _HOST_ARDUINO_H
+
+// Just enough of the Arduino core to build the board independent sources on the host.
+// Time stands still unless a test moves hostMillis; micros() is the real clock, for benchmarks.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+// Like Arduino's String: each one owns a buffer from the heap, even when empty. No small
+// string optimization, so hostHeapAllocs counts what the firmware would allocate.
+extern uint32_t hostHeapAllocs;
+
+class String
+{
+public:
+  String(const char *str = "") { copy(str ? str : ""); }
+  String(const String &other) { copy(other.c_str()); }
+  ~String() { free(buff); }
+  String &operator=(const String &other)
+  {
+    if (this != &other)
+    {
+      free(buff);
+      copy(other.c_str());
+    }
+    return *this;
+  }
+  const char *c_str() const { return buff; }
+  size_t length() const { return len; }
+  String operator+(const char *rhs) const
+  {
+    std::string joined = std::string(buff) + rhs;
+    return String(joined.c_str());
+  }
+
+private:
+  void copy(const char *str)
+  {
+    len = strlen(str);
+    buff = (char *)malloc(len + 1);
+    ++hostHeapAllocs;
+    memcpy(buff, str, len + 1);
+  }
+
+  char *buff;
+  size_t len;
+};
+
+class HostSerial
+{
+public:
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  void print(const char *str) { fputs(str, stdout); }
+  void println(const char *str) { puts(str); }
+};
+extern HostSerial Serial;
+
+extern uint32_t hostMillis;
+inline unsigned long millis() { return hostMillis; }
+unsigned long micros();
+inline void yield() {}
+long random(long howBig);
+long random(long howSmall, long howBig);
+
+#endif // _HOST_ARDUINO_H
@@ -0,0 +1,55 @@
+#ifndef _HOST_ARDUINO_JSON_H
+
+#define _HOST_ARDUINO_JSON_H
+
+#include <Arduino.h>
+
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Flat objects only: members keep the order they were set in, values are numbers or strings.
+// That is all net.cpp builds, so its messages come out the way the real library writes them.
+
+class JsonDocument
+{
+public:
+  class Member
+  {
+  public:
+    Member(JsonDocument &doc, const char *key) : doc(doc), key(key) {}
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    Member &operator=(T value)
+    {
+      return set(std::to_string(value));
+    }
+    Member &operator=(const char *value) { return set(quoted(value)); }
+    Member &operator=(const String &value) { return set(quoted(value.c_str())); }
+
+  private:
+    static std::string quoted(const char *value) { return std::string("\"") + value + "\""; }
+    Member &set(const std::string &json);
+    JsonDocument &doc;
+    const char *key;
+  };
+
+  Member operator[](const char *key) { return Member(*this, key); }
+  void clear() { members.clear(); }
+  // Note: one 16 byte slot per member, plus the strings that were copied in
+  size_t memoryUsage() const;
+  std::string json() const;
+
+private:
+  std::vector<std::pair<std::string, std::string>> members;
+};
+
+template <size_t capacity>
+class StaticJsonDocument : public JsonDocument
+{
+};
+
+size_t serializeJson(const JsonDocument &doc, char *output, size_t outputSize);
+size_t serializeJson(const JsonDocument &doc, HostSerial &output);
+
+#endif // _HOST_ARDUINO_JSON_H
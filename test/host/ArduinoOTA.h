@@ -0,0 +1,34 @@
+#ifndef _HOST_ARDUINO_OTA_H
+
+#define _HOST_ARDUINO_OTA_H
+
+#include <functional>
+
+typedef int ota_error_t;
+enum
+{
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR,
+};
+
+// never updates anything
+class ArduinoOTAClass
+{
+public:
+  void setPort(int port) {}
+  void setHostname(const char *hostname) {}
+  void setPassword(const char *password) {}
+  void setPasswordHash(const char *passwordHash) {}
+  void onStart(std::function<void()> callback) {}
+  void onEnd(std::function<void()> callback) {}
+  void onProgress(std::function<void(unsigned int, unsigned int)> callback) {}
+  void onError(std::function<void(ota_error_t)> callback) {}
+  void begin() {}
+  void handle() {}
+};
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif // _HOST_ARDUINO_OTA_H
@@ -0,0 +1,17 @@
+#ifndef _HOST_ESP_H
+
+#define _HOST_ESP_H
+
+#include <Arduino.h>
+
+class EspClass
+{
+public:
+  void restart() { exit(1); }
+  uint32_t getFreeHeap() { return 246 * 1024; }
+  uint32_t getMinFreeHeap() { return 244 * 1024; }
+  uint32_t getMaxAllocHeap() { return 111 * 1024; }
+};
+extern EspClass ESP;
+
+#endif // _HOST_ESP_H
@@ -0,0 +1,26 @@
+#ifndef _HOST_PREFERENCES_H
+
+#define _HOST_PREFERENCES_H
+
+#include <Arduino.h>
+
+// nvs that forgets everything when the test exits
+class Preferences
+{
+public:
+  bool begin(const char * /*name*/, bool /*readOnly*/) { return true; }
+  void end() {}
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t getBytesLength(const char *key);
+  bool remove(const char *key);
+  size_t putBool(const char *key, bool value) { return putBytes(key, &value, sizeof(value)); }
+  bool getBool(const char *key, bool defaultValue = false)
+  {
+    bool value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+};
+
+#endif // _HOST_PREFERENCES_H
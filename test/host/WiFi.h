@@ -0,0 +1,27 @@
+#ifndef _HOST_WIFI_H
+
+#define _HOST_WIFI_H
+
+#include <Arduino.h>
+
+#define WIFI_STA 1
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+// connected unless a test says otherwise
+class WiFiClass
+{
+public:
+  void mode(int mode) {}
+  void begin(const char *ssid, const char *pass) {}
+  int status() { return hostStatus; }
+  const char *localIP() { return "127.0.0.1"; }
+  int hostStatus = WL_CONNECTED;
+};
+extern WiFiClass WiFi;
+
+class WiFiClient
+{
+};
+
+#endif // _HOST_WIFI_H
@@ -0,0 +1,20 @@
+#ifndef _HOST_CHECK_H
+
+#define _HOST_CHECK_H
+
+#include <stdio.h>
+
+// Keeps going after a failed check, so one run shows all of them. main returns checkFailures.
+static int checkFailures = 0;
+
+#define CHECK(COND)                                                   \
+  do                                                                  \
+  {                                                                   \
+    if (!(COND))                                                      \
+    {                                                                 \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #COND); \
+      ++checkFailures;                                                \
+    }                                                                 \
+  } while (0)
+
+#endif // _HOST_CHECK_H
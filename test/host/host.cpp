@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <Esp.h>
+#include <Preferences.h>
+
+#include <chrono>
+#include <map>
+#include <stdarg.h>
+#include <vector>
+
+HostSerial Serial;
+EspClass ESP;
+uint32_t hostMillis = 0;
+uint32_t hostHeapAllocs = 0;
+
+int HostSerial::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  const int written = vprintf(format, args);
+  va_end(args);
+  return written;
+}
+
+unsigned long micros()
+{
+  static const auto start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+long random(long howBig) { return howBig ? ::random() % howBig : 0; }
+long random(long howSmall, long howBig) { return howSmall + random(howBig - howSmall); }
+
+static std::map<std::string, std::vector<uint8_t>> nvs;
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+  const uint8_t *const bytes = (const uint8_t *)value;
+  nvs[key].assign(bytes, bytes + len);
+  return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+  const auto iter = nvs.find(key);
+  if (iter == nvs.end() || iter->second.size() > maxLen)
+    return 0;
+  memcpy(buf, iter->second.data(), iter->second.size());
+  return iter->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+  const auto iter = nvs.find(key);
+  return iter == nvs.end() ? 0 : iter->second.size();
+}
+
+bool Preferences::remove(const char *key) { return nvs.erase(key) > 0; }
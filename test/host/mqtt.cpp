@@ -0,0 +1,123 @@
+#include <Adafruit_MQTT.h>
+#include <ArduinoJson.h>
+#include <ArduinoOTA.h>
+#include <WiFi.h>
+
+#include <algorithm>
+
+// Stand-ins that only net.cpp needs
+
+WiFiClass WiFi;
+ArduinoOTAClass ArduinoOTA;
+
+std::vector<HostMqttMsg> hostPublished;
+std::deque<HostMqttMsg> hostIncoming;
+bool hostMqttUp = true;
+int hostMqttPublishFails = 0;
+
+bool Adafruit_MQTT_Publish::publish(uint8_t *payload, uint16_t len)
+{
+  if (!mqtt->isConnected)
+    return false;
+  if (hostMqttPublishFails > 0)
+  {
+    --hostMqttPublishFails;
+    return false;
+  }
+  hostPublished.push_back({topic, std::string((const char *)payload, len), hostMillis});
+  return true;
+}
+
+bool Adafruit_MQTT_Publish::publish(const char *payload)
+{
+  return publish((uint8_t *)payload, (uint16_t)strlen(payload));
+}
+
+int8_t Adafruit_MQTT::connect()
+{
+  isConnected = hostMqttUp;
+  return isConnected ? 0 : 1;
+}
+
+bool Adafruit_MQTT::disconnect()
+{
+  isConnected = false;
+  return true;
+}
+
+bool Adafruit_MQTT::subscribe(Adafruit_MQTT_Subscribe *sub)
+{
+  for (Adafruit_MQTT_Subscribe *subscription : subscriptions)
+    if (subscription == sub)
+      return true;
+  subscriptions.push_back(sub);
+  return true;
+}
+
+Adafruit_MQTT_Subscribe *Adafruit_MQTT::readSubscription(int16_t timeout)
+{
+  while (isConnected && !hostIncoming.empty())
+  {
+    const HostMqttMsg msg = hostIncoming.front();
+    hostIncoming.pop_front();
+    for (Adafruit_MQTT_Subscribe *subscription : subscriptions)
+    {
+      if (msg.topic != subscription->topic)
+        continue;
+      // Note: like the library, payload is cut to fit and always null terminated
+      subscription->datalen = (uint16_t)std::min(msg.payload.size(), (size_t)SUBSCRIPTIONDATALEN - 1);
+      memcpy(subscription->lastread, msg.payload.data(), subscription->datalen);
+      subscription->lastread[subscription->datalen] = 0;
+      return subscription;
+    }
+  }
+  return nullptr;
+}
+
+JsonDocument::Member &JsonDocument::Member::set(const std::string &json)
+{
+  for (auto &member : doc.members)
+  {
+    if (member.first == key)
+    {
+      member.second = json;
+      return *this;
+    }
+  }
+  doc.members.push_back(std::make_pair(std::string(key), json));
+  return *this;
+}
+
+size_t JsonDocument::memoryUsage() const
+{
+  size_t result = 0;
+  for (const auto &member : members)
+    result += 16 + (member.second[0] == '"' ? member.second.size() - 1 : 0);
+  return result;
+}
+
+std::string JsonDocument::json() const
+{
+  std::string result = "{";
+  for (const auto &member : members)
+    result += (result.size() > 1 ? ",\"" : "\"") + member.first + "\":" + member.second;
+  return result + "}";
+}
+
+size_t serializeJson(const JsonDocument &doc, char *output, size_t outputSize)
+{
+  const std::string json = doc.json();
+  if (outputSize == 0)
+    return 0;
+  const size_t written = std::min(json.size(), outputSize - 1);
+  memcpy(output, json.data(), written);
+  output[written] = 0;
+  return written;
+}
+
+size_t serializeJson(const JsonDocument &doc, HostSerial &output)
+{
+  const std::string json = doc.json();
+  output.print(json.c_str());
+  return json.size();
+}
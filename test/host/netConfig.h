@@ -0,0 +1,8 @@
+#ifndef _NETCONFIG_H
+
+#define _NETCONFIG_H
+
+// include/netConfig.h.sample, for the host
+#define OTA_PORT 8266
+
+#endif // _NETCONFIG_H
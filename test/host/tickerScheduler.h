@@ -0,0 +1,34 @@
+#ifndef _HOST_TICKER_SCHEDULER_H
+
+#define _HOST_TICKER_SCHEDULER_H
+
+#include <inttypes.h>
+#include <vector>
+
+typedef void (*callback_t)();
+
+// Keeps the tickers, so a test can run the ones of a given period when it wants
+class TickerScheduler
+{
+public:
+  void sched(callback_t callback, uint32_t timer_milliseconds)
+  {
+    tickers.push_back({callback, timer_milliseconds});
+  }
+  void run(uint32_t timer_milliseconds)
+  {
+    for (const Ticker &ticker : tickers)
+      if (ticker.timer_milliseconds == timer_milliseconds)
+        ticker.callback();
+  }
+
+private:
+  typedef struct
+  {
+    callback_t callback;
+    uint32_t timer_milliseconds;
+  } Ticker;
+  std::vector<Ticker> tickers;
+};
+
+#endif // _HOST_TICKER_SCHEDULER_H
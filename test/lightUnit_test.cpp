@@ -0,0 +1,89 @@
+#include "check.h"
+#include "../src/animations.h"
+#include "../src/common.h"
+#include "../src/lightUnit.h"
+
+// Layer lists and group index of lightUnit.cpp, with the real animations driving them.
+// Drawing is not linked in: lightUnitFinalIteration only has to exist.
+
+State state;
+
+uint32_t lightsClockMs() { return hostMillis; }
+void lightUnitFinalIteration(void *lightUnitPtr) {}
+
+// units seen walking the layer lists bottom to top, or -1 if the walk does not end
+static int walkedUnits()
+{
+  int count = 0;
+  for (LightUnit *unitPtr = getFirstLightUnit(); unitPtr != nullptr; unitPtr = getLightUnitAbove(unitPtr))
+  {
+    LightUnit *const abovePtr = getLightUnitAbove(unitPtr);
+    if (abovePtr == unitPtr || (abovePtr && getLightUnitBelow(abovePtr) != unitPtr))
+      return -1;
+    if (++count > (int)lightUnitsSize())
+      return -1;
+  }
+  return count;
+}
+
+static void testFlashlightThenScan()
+{
+  // scan replaces the flashlight, whose doneCallback sets crazy on the very same id
+  startAnimationFlashlight();
+  CHECK(lightUnitsSize() == 1 && walkedUnits() == 1);
+  startAnimationScan();
+  CHECK(lightUnitsSize() == 1 && walkedUnits() == 1);
+  LightUnit *const unitPtr = getTopLightUnit();
+  CHECK(unitPtr && unitPtr->kind == lightUnitKindTable);
+
+  // and the other way around, with more units around it
+  setLightUnit(3, LightUnit());
+  setLightUnit(minDynamicId + 7, LightUnit());
+  startAnimationFlashlight();
+  CHECK(lightUnitsSize() == 3 && walkedUnits() == 3);
+  stopAnimationFlashlight();
+  CHECK(lightUnitsSize() == 3 && walkedUnits() == 3);
+  LightUnit unit;
+  CHECK(lightUnitExists(minDynamicId - 1, &unit) && unit.animation.randomPixels);
+  stopAnimationCrazy();
+  CHECK(lightUnitsSize() == 2 && walkedUnits() == 2);
+  rmLightUnits();
+  CHECK(lightUnitsSize() == 0 && walkedUnits() == 0);
+}
+
+static void setAgainDone(const LightUnit &unit)
+{
+  LightUnit again = LightUnit();
+  again.group = 7;
+  again.layer = 2;
+  setLightUnit(unit.id, again);
+}
+
+static void testSetAgainInGroup()
+{
+  // same id set from its own doneCallback, in a group and in another layer
+  LightUnit unit = LightUnit();
+  unit.group = 7;
+  unit.doneCallback = &setAgainDone;
+  setLightUnit(20, unit);
+  setLightUnit(21, LightUnit());
+
+  LightUnit replacement = LightUnit();
+  replacement.group = 7;
+  setLightUnit(20, replacement);
+  CHECK(lightUnitsSize() == 2 && walkedUnits() == 2);
+  CHECK(getLightUnitGroup(7).size() == 1);
+  CHECK(getLightUnit(20) && getLightUnit(20)->layer == 0);
+
+  rmLightUnitGroup(7);
+  CHECK(lightUnitsSize() == 1 && walkedUnits() == 1 && getLightUnitGroup(7).empty());
+  rmLightUnits();
+}
+
+int main()
+{
+  testFlashlightThenScan();
+  testSetAgainInGroup();
+  printf("lightUnit_test: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
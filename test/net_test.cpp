@@ -0,0 +1,350 @@
+#include "check.h"
+#include "../src/buttons.h"
+#include "../src/common.h"
+#include "../src/keyStats.h"
+#include "../src/net.h"
+#include "../src/reactions.h"
+#include "../src/wifiConfig.h"
+#include "tickerScheduler.h"
+
+#include <Adafruit_MQTT.h>
+#include <WiFi.h>
+
+// net.cpp against the fake broker of host/Adafruit_MQTT.h: what gets published, in which
+// order and how long after the event. Keys come in through keyPressCallback, like trellis.read().
+
+State state;
+
+// What the rest of the firmware would provide
+static WifiConfigData wifiConfigData;
+void wifiConfig_init(bool forceNvClear) { wifiConfigData.mqttTopic = "/trelliswifi/"; }
+const WifiConfigData &wifiConfig_get() { return wifiConfigData; }
+void startAnimationFlashlight(uint64_t expiration, uint32_t color, bool pulse, bool blink, bool doneCallback) {}
+bool isBatteryLow(float *batteryVoltagePtr)
+{
+  *batteryVoltagePtr = 3.7f;
+  return false;
+}
+uint64_t getActivePixels() { return 0; }
+uint32_t lightsOccludedUnits() { return 0; }
+uint32_t lightsOccludedPixels() { return 0; }
+uint32_t lightUnitsSize() { return 0; }
+void lightsRedrawPixels(uint64_t pixels) {}
+void localButtonProcess(uint64_t pressed, uint64_t longPressed) {}
+void swipeKeyEdge(int key, bool isDown, uint32_t ms) {}
+void keyStatsAdd(int buttonIndex, ButtonKeyEvent keyEvent, uint32_t heldMs) {}
+const KeyUsage &keyStatsGet(int buttonIndex)
+{
+  static const KeyUsage usage = {0};
+  return usage;
+}
+static LatencyStats reactionStats;
+int32_t reactionsKeyEvent(int buttonIndex, ButtonKeyEvent keyEvent, uint32_t eventMillis) { return -1; }
+const LatencyStats &reactionsLatencyStats() { return reactionStats; }
+
+static const std::string keyTopic = "/trelliswifi/key";
+static const std::string cmdTopic = "/trelliswifi/cmd";
+static const std::string ackTopic = "/trelliswifi/ack";
+
+static void keyEdge(int key, bool isDown, uint32_t ms)
+{
+  hostMillis = ms;
+  keyEvent evt = {0};
+  evt.bit.NUM = key;
+  evt.bit.EDGE = isDown ? SEESAW_KEYPAD_EDGE_RISING : SEESAW_KEYPAD_EDGE_FALLING;
+  keyPressCallback(evt);
+}
+
+// what lightsFastTick does with the edges trellis.read() saw
+static void fastTick(uint32_t ms)
+{
+  hostMillis = ms;
+  buttonPressEvents(state.buttons.changedState & state.buttons.pressed);
+  for (int i = 0; i < Y_DIM * X_DIM; ++i)
+    if (getFlag(state.buttons.changedState, i) && !getFlag(state.buttons.pressed, i))
+      buttonKeyEvent(i, buttonKeyEventRelease);
+  state.buttons.changedState = 0;
+}
+
+static void loop(uint32_t ms)
+{
+  hostMillis = ms;
+  myMqttLoop();
+}
+
+static long jsonNumber(const std::string &json, const char *name)
+{
+  const std::string key = std::string("\"") + name + "\":";
+  const size_t pos = json.find(key);
+  return pos == std::string::npos ? -1 : strtol(json.c_str() + pos + key.size(), nullptr, 10);
+}
+
+static std::string jsonString(const std::string &json, const char *name)
+{
+  const std::string key = std::string("\"") + name + "\":\"";
+  const size_t pos = json.find(key);
+  if (pos == std::string::npos)
+    return "";
+  const size_t start = pos + key.size();
+  return json.substr(start, json.find('"', start) - start);
+}
+
+// Commands only need their seq here, which is what gets them acked
+bool parseMqttCmd(const char *msg, size_t msgSize, uint32_t *seqPtr)
+{
+  const long seq = jsonNumber(msg, "seq");
+  if (seq < 0)
+    return false;
+  *seqPtr = (uint32_t)seq;
+  return true;
+}
+
+typedef struct
+{
+  long key;
+  std::string event;
+  long ms;
+  long lag;
+  uint32_t publishedMs;
+} KeySeen;
+
+static std::vector<KeySeen> keysPublished()
+{
+  std::vector<KeySeen> result;
+  for (const HostMqttMsg &msg : hostPublished)
+    if (msg.topic == keyTopic)
+      result.push_back({jsonNumber(msg.payload, "key"), jsonString(msg.payload, "e"),
+                        jsonNumber(msg.payload, "ms"), jsonNumber(msg.payload, "lag"), msg.ms});
+  hostPublished.clear();
+  return result;
+}
+
+static void connect(uint32_t ms)
+{
+  hostMqttUp = true;
+  loop(ms);     // connects
+  loop(ms + 1); // sees it connected
+  CHECK(isMqttConnected());
+  hostPublished.clear();
+}
+
+static void testKeyEventOrder()
+{
+  // key 9 has the lower index, but key 12 went down first
+  keyEdge(12, true, 10002);
+  keyEdge(9, true, 10005);
+  fastTick(10010);
+  CHECK(keysPublished().empty()); // nothing goes out from the fast tick
+  loop(10013);
+  std::vector<KeySeen> seen = keysPublished();
+  CHECK(seen.size() == 2);
+  CHECK(seen.size() == 2 && seen[0].key == 12 && seen[0].ms == 10002 && seen[1].key == 9 && seen[1].ms == 10005);
+
+  // in one tick: key 9 up, key 20 down, key 12 up. Presses are handled before releases
+  keyEdge(9, false, 10100);
+  keyEdge(20, true, 10102);
+  keyEdge(12, false, 10104);
+  fastTick(10110);
+  loop(10111);
+  seen = keysPublished();
+  CHECK(seen.size() == 3);
+  const long expectedKeys[] = {9, 20, 12};
+  const char *const expectedEvents[] = {"release", "press", "release"};
+  for (size_t i = 0; i < seen.size() && i < 3; ++i)
+  {
+    CHECK(seen[i].key == expectedKeys[i] && seen[i].event == expectedEvents[i]);
+    CHECK(i == 0 || seen[i].ms >= seen[i - 1].ms);
+  }
+
+  // a press and release both seen by one tick still go out as press, then release
+  keyEdge(20, false, 10150);
+  keyEdge(30, true, 10151);
+  keyEdge(30, false, 10153);
+  fastTick(10160);
+  loop(10161);
+  seen = keysPublished();
+  CHECK(seen.size() == 3);
+  CHECK(seen.size() == 3 && seen[0].key == 20 && seen[1].key == 30 && seen[1].event == "press" &&
+        seen[2].key == 30 && seen[2].event == "release");
+}
+
+// first fast tick after ms
+static uint32_t tickAfter(uint32_t ms) { return (ms / 20 + 1) * 20; }
+
+static void testKeyEventLatency()
+{
+  // lag is edge to publish: fast tick runs every 20 ms and the loop right after it
+  std::vector<uint32_t> lags;
+  for (uint32_t edgeMs = 20001; edgeMs < 21000; edgeMs += 37)
+  {
+    keyEdge(40, true, edgeMs);
+    fastTick(tickAfter(edgeMs));
+    loop(tickAfter(edgeMs) + 1);
+    keyEdge(40, false, edgeMs + 25);
+    fastTick(tickAfter(edgeMs + 25));
+    loop(tickAfter(edgeMs + 25) + 1);
+    for (const KeySeen &keySeen : keysPublished())
+    {
+      CHECK(keySeen.lag == (long)(keySeen.publishedMs - keySeen.ms));
+      lags.push_back(keySeen.lag);
+    }
+  }
+  CHECK(lags.size() == 2 * 27);
+  uint32_t maxLag = 0;
+  for (uint32_t lag : lags)
+    if (lag > maxLag)
+      maxLag = lag;
+  CHECK(maxLag <= 21);
+  printf("key to publish lag, %zu events: max %" PRIu32 " ms\n", lags.size(), maxLag);
+}
+
+static void testKeyEventsWhileDisconnected(TickerScheduler &ts)
+{
+  // publish fails: events stay queued and go out, in order, once mqtt is back
+  keyEdge(50, true, 30000);
+  keyEdge(51, true, 30001);
+  fastTick(30010);
+  hostMqttPublishFails = 1;
+  loop(30011); // fails, and disconnects
+  loop(30012); // reconnects
+  loop(30013);
+  std::vector<KeySeen> seen = keysPublished();
+  CHECK(seen.size() == 2);
+  CHECK(seen.size() == 2 && seen[0].key == 50 && seen[0].lag == 13 && seen[1].key == 51);
+
+  // broker down: events seen before that still go out, later ones are not kept
+  hostMqttUp = false;
+  keyEdge(50, false, 30100);
+  fastTick(30110);
+  hostMqttPublishFails = 1;
+  loop(30111);
+  loop(30112);
+  CHECK(!isMqttConnected());
+  keyEdge(51, false, 30200);
+  fastTick(30210);
+  for (unsigned int i = 0; i < defaultMqttReconnect; ++i)
+    ts.run(1000);
+  hostMqttUp = true;
+  loop(40000);
+  loop(40001);
+  seen = keysPublished();
+  CHECK(seen.size() == 1);
+  CHECK(seen.size() == 1 && seen[0].key == 50 && seen[0].event == "release" && seen[0].lag == 9901);
+}
+
+static void cmd(long seq)
+{
+  hostIncoming.push_back({cmdTopic, "{\"op\":\"set\",\"seq\":" + std::to_string(seq) + "}", hostMillis});
+}
+
+static std::vector<long> acksPublished()
+{
+  std::vector<long> result;
+  for (const HostMqttMsg &msg : hostPublished)
+    if (msg.topic == ackTopic)
+      result.push_back(jsonNumber(msg.payload, "seq"));
+  hostPublished.clear();
+  return result;
+}
+
+static void reconnect(TickerScheduler &ts, uint32_t ms)
+{
+  for (unsigned int i = 0; i < defaultMqttReconnect; ++i)
+    ts.run(1000);
+  hostMqttUp = true;
+  loop(ms);
+  loop(ms + 1);
+  CHECK(isMqttConnected());
+}
+
+static void testCmdAcks(TickerScheduler &ts)
+{
+  // acked after a show that started once the command was parsed, not by one already going
+  const uint32_t earlyRefreshUs = micros();
+  cmd(1);
+  cmd(2);
+  loop(50000);
+  CHECK(cmdAcksPending());
+  cmdAckRendered(earlyRefreshUs - 1);
+  loop(50001);
+  CHECK(acksPublished().empty() && cmdAcksPending());
+  cmdAckRendered(micros());
+  CHECK(!cmdAcksPending());
+  loop(50002);
+  CHECK(acksPublished() == std::vector<long>({1, 2}));
+
+  // publish fails: the ack stays, and goes out before the next one
+  cmd(3);
+  loop(50100);
+  cmdAckRendered(micros());
+  hostMqttPublishFails = 1;
+  loop(50101);
+  CHECK(acksPublished().empty());
+  cmd(4);
+  reconnect(ts, 50200);
+  cmdAckRendered(micros());
+  loop(50202);
+  CHECK(acksPublished() == std::vector<long>({3, 4}));
+
+  // connection drops in the middle of a loop, right before the acks: they stay too
+  cmd(5);
+  loop(50300);
+  cmdAckRendered(micros());
+  cmd(6);
+  hostMqttPublishFails = 1; // the reset of the cmd topic, after reading 6
+  loop(50301);
+  CHECK(acksPublished().empty() && cmdAcksPending());
+  hostMqttUp = false;
+  reconnect(ts, 50400);
+  CHECK(acksPublished() == std::vector<long>({5}));
+  cmdAckRendered(micros());
+  loop(50402);
+  CHECK(acksPublished() == std::vector<long>({6}));
+}
+
+// heap allocations of a sendOperState, as counted by the host String, and msgs published
+static uint32_t operStateAllocs(bool compact, size_t *publishedPtr)
+{
+  state.compactOperState = compact;
+  hostPublished.clear();
+  const uint32_t startAllocs = hostHeapAllocs;
+  CHECK(sendOperState());
+  const uint32_t allocs = hostHeapAllocs - startAllocs;
+  *publishedPtr = hostPublished.size();
+  hostPublished.clear();
+  return allocs;
+}
+
+static void testOperStateAllocs()
+{
+  // a String per value for the topics, none for the compact msg
+  size_t topicsPublished;
+  size_t compactPublished;
+  const uint32_t topicsAllocs = operStateAllocs(false, &topicsPublished);
+  const uint32_t compactAllocs = operStateAllocs(true, &compactPublished);
+  CHECK(topicsAllocs == 14 && topicsPublished == 4);
+  CHECK(compactAllocs == 0 && compactPublished == 1);
+  printf("sendOperState heap allocations: topics %" PRIu32 " in %zu msgs, compact %" PRIu32 " in %zu msg\n",
+         topicsAllocs, topicsPublished, compactAllocs, compactPublished);
+}
+
+int main()
+{
+  TickerScheduler ts;
+  state.initIsDone = true;
+  state.immediateButtonEvents = true;
+  state.compactOperState = true;
+  state.minPressMs = 200;
+  state.longPressMs = 2400;
+  state.maxPressMs = 15000;
+  initMyMqtt(ts);
+  connect(10000);
+
+  testKeyEventOrder();
+  testKeyEventLatency();
+  testKeyEventsWhileDisconnected(ts);
+  testCmdAcks(ts);
+  testOperStateAllocs();
+  printf("net_test: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
@@ -0,0 +1,134 @@
+#include "check.h"
+#include <Arduino.h>
+#include "../src/bitboard.h"
+#include "../src/prng.h"
+
+// The point of prng.h is that a seed draws the same thing on the device and anywhere
+// else, so the sequences below are pinned. prngSeed(0) is the first splitmix64 output
+// for state 0, as published with the reference code.
+//
+// Then, what a frame of the crazy animation (randomPixels and randomColor) costs, drawn
+// like lights.cpp did with random() before, and like it does with the unit's prng now.
+// Note: host random() is a cheap libc generator, while the esp32 one reads the hardware rng
+// on every call. So the random() numbers are a lower bound of what the device paid.
+
+static const uint32_t benchFrames = 2000000;
+
+static void checkGoldenSequences()
+{
+  CHECK(prngSeed(0) == 0xe220a8397b1dcdafULL);
+  CHECK(prngSeed(1) == 0x910a2dec89025cc1ULL);
+
+  static const uint64_t golden[] = {
+      0x4b46a55df3611b9bULL, 0xd7e1f1410e763ef4ULL, 0x5f14ec66975f9b06ULL,
+      0x3b2c74fad44d6cdbULL, 0xdbea40d60760f050ULL, 0x008645ca872e0cd2ULL,
+  };
+  uint64_t rng = prngSeed(1);
+  for (const uint64_t value : golden)
+    CHECK(prngNext(rng) == value);
+
+  static const uint32_t goldenColors[] = {0x61bd30UL, 0x8067f9UL, 0xa13490UL, 0x76c85aUL};
+  rng = prngSeed(9);
+  for (const uint32_t color : goldenColors)
+    CHECK(prngColor(rng) == color);
+
+  static const uint32_t goldenPixelColors[] = {0x3cdb0348UL, 0x06a48667UL, 0x6dfa659dUL, 0xbec5d7adUL};
+  for (int i = 0; i < 4; ++i)
+    CHECK(prngPixelColor(0x1234567, i * 21) == goldenPixelColors[i]);
+
+  // pixel colors do not depend on the order they are worked out in
+  CHECK(prngPixelColor(0x1234567, 63) == prngPixelColor(0x1234567, 63));
+
+  // same seed, same frames; and a 0 state would get stuck at 0
+  uint64_t left = prngSeed(42);
+  uint64_t right = prngSeed(42);
+  for (int i = 0; i < 1000; ++i)
+    CHECK(prngNext(left) == prngNext(right) && left != 0);
+}
+
+// what lightUnitIterate drew for crazy before: 31 bits of random() at a time for the pixels,
+// then a random() color for every lit pixel, in the loop that set them
+typedef struct
+{
+  uint64_t tempPixels;
+} BeforeState;
+
+static uint64_t crazyFrameBefore(BeforeState &state, uint32_t &colors)
+{
+  uint64_t pixels = random(0, 0x7fffffffUL);
+  pixels ^= state.tempPixels * 2;
+  state.tempPixels *= 0x100000000;
+  state.tempPixels ^= pixels;
+  colors = 0;
+  for (uint64_t lit = pixels; lit; lit &= lit - 1)
+    colors ^= random(1, 0x00ffffff);
+  return pixels;
+}
+
+static uint64_t crazyFrameAfter(uint64_t &rng, uint32_t &seed)
+{
+  const uint64_t pixels = prngNext(rng);
+  seed = (uint32_t)prngNext(rng) | 1;
+  return pixels;
+}
+
+// what the compositor does with the frame: a color for every lit pixel
+static uint32_t crazyPixelColors(uint64_t pixels, uint32_t seed)
+{
+  uint32_t colors = 0;
+  for (; pixels; pixels &= pixels - 1)
+    colors ^= prngPixelColor(seed, bitboardFirst(pixels));
+  return colors;
+}
+
+static void benchCrazyFrame()
+{
+  uint32_t seed = 0;
+  uint64_t sink = 0;
+  uint64_t litPixels = 0;
+
+  BeforeState before = {0};
+  unsigned long startUs = micros();
+  for (uint32_t frame = 0; frame < benchFrames; ++frame)
+  {
+    uint32_t colors = 0;
+    const uint64_t pixels = crazyFrameBefore(before, colors);
+    sink ^= pixels ^ colors;
+    litPixels += bitboardCount(pixels);
+  }
+  const double beforeNs = (micros() - startUs) * 1000.0 / benchFrames;
+  const double beforeLit = (double)litPixels / benchFrames;
+
+  uint64_t rng = prngSeed(1);
+  startUs = micros();
+  for (uint32_t frame = 0; frame < benchFrames; ++frame)
+    sink ^= crazyFrameAfter(rng, seed) ^ seed;
+  const double afterNs = (micros() - startUs) * 1000.0 / benchFrames;
+
+  litPixels = 0;
+  startUs = micros();
+  for (uint32_t frame = 0; frame < benchFrames; ++frame)
+  {
+    const uint64_t pixels = crazyFrameAfter(rng, seed);
+    sink ^= crazyPixelColors(pixels, seed);
+    litPixels += bitboardCount(pixels);
+  }
+  const double composeNs = (micros() - startUs) * 1000.0 / benchFrames;
+  const double afterLit = (double)litPixels / benchFrames;
+
+  printf("%-40s %10s %8s\n", "crazy frame", "ns/frame", "lit");
+  printf("%-40s %10.1f %8.1f   (lower bound, see above)\n", "random(): pixels, color of each lit one", beforeNs,
+         beforeLit);
+  printf("%-40s %10.1f\n", "prng: pixels and seed", afterNs);
+  printf("%-40s %10.1f %8.1f\n", "prng: pixels, seed, color of each lit one", composeNs, afterLit);
+  volatile uint64_t keep = sink;
+  (void)keep;
+}
+
+int main()
+{
+  checkGoldenSequences();
+  benchCrazyFrame();
+  printf("prng_bench: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
@@ -0,0 +1,189 @@
+#include "check.h"
+#include "../src/common.h"
+#include "../src/lightUnit.h"
+
+#include <Preferences.h>
+#include <string.h>
+
+// Saves units of every kind, loads them back, and looks at what went to nvs in between.
+
+State state;
+
+uint32_t lightsClockMs() { return hostMillis; }
+void lightUnitFinalIteration(void *lightUnitPtr) {}
+
+static const size_t headerSize = 4;
+static const size_t unitSize = 82; // without its payload
+
+static size_t savedSize()
+{
+  Preferences preferences;
+  return preferences.getBytesLength("scene");
+}
+
+static void save()
+{
+  hostMillis += 61 * 1000; // past the wear limit
+  sceneSaveRequest();
+}
+
+static std::vector<LightUnit> units()
+{
+  std::vector<LightUnit> result;
+  for (LightUnit *unitPtr = getFirstLightUnit(); unitPtr != nullptr; unitPtr = getLightUnitAbove(unitPtr))
+    result.push_back(*unitPtr);
+  return result;
+}
+
+// Note: after a load, so both sides went through setLightUnit
+static bool sameUnits(const std::vector<LightUnit> &left, const std::vector<LightUnit> &right)
+{
+  if (left.size() != right.size())
+    return false;
+  for (size_t i = 0; i < left.size(); ++i)
+    if (!equivalentLightUnits(left[i], right[i]))
+      return false;
+  return true;
+}
+
+static void testPayloadSizes()
+{
+  rmLightUnits();
+  LightUnit unit = LightUnit();
+  unit.pixelMask = 0xff;
+  unit.color = 0x123456;
+  setLightUnit(1, unit);
+  save();
+  CHECK(savedSize() == headerSize + unitSize);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindText;
+  strcpy(unit.payload.text, "hi");
+  setLightUnit(1, unit);
+  save();
+  CHECK(savedSize() == headerSize + unitSize + 1 + 2);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindTable;
+  unit.payload.table.count = 3;
+  setLightUnit(1, unit);
+  save();
+  CHECK(savedSize() == headerSize + unitSize + 2 + 3 * (8 + 4));
+
+  // indices up to 5, cycle up to 9
+  unit = LightUnit();
+  unit.kind = lightUnitKindIndexed;
+  unit.payload.indexed.indices[7] = 0x50;
+  unit.payload.indexed.cycleFirst = 2;
+  unit.payload.indexed.cycleLast = 9;
+  setLightUnit(1, unit);
+  save();
+  CHECK(savedSize() == headerSize + unitSize + 32 + 1 + 10 * 4 + 3);
+
+  unit.payload.indexed.cycleLast = 2;
+  setLightUnit(1, unit);
+  save();
+  CHECK(savedSize() == headerSize + unitSize + 32 + 1 + 6 * 4 + 3);
+}
+
+static void testRoundTrip()
+{
+  rmLightUnits();
+  LightUnit unit = LightUnit();
+  unit.pixelMask = 0x8001;
+  unit.color = 0xff0000;
+  unit.blend = lightUnitBlendAdd;
+  unit.layer = 2;
+  unit.group = 4;
+  unit.animation.speed = 3;
+  unit.animation.blink = true;
+  unit.animation.dependsOn = 600;
+  setLightUnit(600, unit);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindText;
+  strcpy(unit.payload.text, "0123456789012345678901234567890"); // longest there is
+  setLightUnit(601, unit);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindAutomaton;
+  unit.payload.automaton.birth = 1 << 3;
+  unit.payload.automaton.survive = (1 << 2) | (1 << 3);
+  unit.payload.automaton.wrap = true;
+  setLightUnit(602, unit);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindIndexed;
+  for (size_t i = 0; i < lightUnitPaletteIndices; ++i)
+    unit.payload.indexed.indices[i] = (uint8_t)(i * 0x11);
+  for (size_t i = 0; i < lightUnitPaletteSize; ++i)
+    unit.payload.indexed.palette[i] = (uint32_t)(i * 0x010203);
+  unit.payload.indexed.cycleFirst = 1;
+  unit.payload.indexed.cycleLast = 4;
+  unit.payload.indexed.cycleSteps = 6;
+  setLightUnit(603, unit);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindProgram;
+  unit.payload.program = 3;
+  setLightUnit(604, unit);
+
+  unit = LightUnit();
+  unit.kind = lightUnitKindTable;
+  for (size_t row = 0; row < lightUnitTableSize; ++row)
+  {
+    unit.payload.table.masks[row] = 1ULL << row;
+    unit.payload.table.colors[row] = (uint32_t)row;
+  }
+  unit.payload.table.count = lightUnitTableSize;
+  unit.payload.table.pingPong = true;
+  setLightUnit(605, unit);
+
+  // units with callbacks are not saved
+  unit = LightUnit();
+  unit.doneCallback = [](const LightUnit &) {};
+  setLightUnit(606, unit);
+
+  save();
+  rmLightUnit(606);
+  const std::vector<LightUnit> saved = units();
+  CHECK(saved.size() == 6);
+  rmLightUnits();
+  CHECK(sceneLoad());
+  CHECK(sameUnits(units(), saved));
+}
+
+static void testBogusScene()
+{
+  // loading a bad blob leaves the units alone
+  const std::vector<LightUnit> before = units();
+  Preferences preferences;
+  std::vector<uint8_t> blob(savedSize());
+  CHECK(preferences.getBytes("scene", blob.data(), blob.size()) == blob.size());
+
+  std::vector<uint8_t> bogus(blob.begin(), blob.end() - 1);
+  preferences.putBytes("scene", bogus.data(), bogus.size());
+  CHECK(!sceneLoad() && sameUnits(units(), before));
+
+  bogus = blob;
+  bogus[3] += 1; // one more unit than there is
+  preferences.putBytes("scene", bogus.data(), bogus.size());
+  CHECK(!sceneLoad() && sameUnits(units(), before));
+
+  bogus = blob;
+  bogus[headerSize + unitSize - 1] = lightUnitKindText; // first unit is plain pixels
+  preferences.putBytes("scene", bogus.data(), bogus.size());
+  CHECK(!sceneLoad() && sameUnits(units(), before));
+
+  preferences.putBytes("scene", blob.data(), blob.size());
+  CHECK(sceneLoad() && sameUnits(units(), before));
+}
+
+int main()
+{
+  testPayloadSizes();
+  testRoundTrip();
+  testBogusScene();
+  printf("scenes_test: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
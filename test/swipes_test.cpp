@@ -0,0 +1,231 @@
+#include "check.h"
+#include "../src/bitboard.h"
+#include "../src/common.h"
+#include "../src/gestures.h"
+
+// Feeds key traces into the swipe detector, the way buttons.cpp does: state.buttons is
+// updated first, then swipeKeyEdge gets the edge with its timestamp. Keys are 0 based,
+// so key 8 is the first one of the second row.
+
+State state;
+
+typedef struct
+{
+  int count;
+  std::string eventName;
+  std::string direction;
+  int fromKey;
+  int toKey;
+  uint64_t path;
+  uint32_t durationMs;
+  std::string action;
+} SwipeSeen;
+
+static SwipeSeen seen;
+
+bool sendSwipeEvent(const char *eventName, const char *direction, int fromKey, int toKey,
+                    uint64_t path, uint32_t durationMs)
+{
+  ++seen.count;
+  seen.eventName = eventName;
+  seen.direction = direction ? direction : "";
+  seen.fromKey = fromKey;
+  seen.toKey = toKey;
+  seen.path = path;
+  seen.durationMs = durationMs;
+  return true;
+}
+
+void gestureRunAction(const char *action) { seen.action = action; }
+
+static void keyPress(int key, uint32_t ms)
+{
+  hostMillis = ms;
+  setFlag(state.buttons.pressed, key);
+  state.buttons.pressMillis[key] = ms;
+  swipeKeyEdge(key, true, ms);
+}
+
+static void keyRelease(int key, uint32_t ms)
+{
+  hostMillis = ms;
+  clearFlag(state.buttons.pressed, key);
+  state.buttons.releaseMillis[key] = ms;
+  swipeKeyEdge(key, false, ms);
+}
+
+// taps each key for heldMs, one every stepMs. Overlapping taps keep the finger down
+static void trace(const int *keys, size_t keysSize, uint32_t stepMs, uint32_t heldMs)
+{
+  seen = SwipeSeen();
+  uint32_t ms = hostMillis + 1000;
+  for (size_t i = 0; i < keysSize; ++i)
+  {
+    keyPress(keys[i], ms + i * stepMs);
+    if (heldMs < stepMs)
+      keyRelease(keys[i], ms + i * stepMs + heldMs);
+    else if (i > 0)
+      keyRelease(keys[i - 1], ms + i * stepMs + 1);
+  }
+  if (heldMs >= stepMs)
+    keyRelease(keys[keysSize - 1], ms + (keysSize - 1) * stepMs + heldMs);
+
+  // let the trail go idle
+  hostMillis = ms + (keysSize - 1) * stepMs + heldMs + 1000;
+  swipesFastTick();
+}
+
+#define TRACE(STEP_MS, HELD_MS, ...)                                 \
+  do                                                                 \
+  {                                                                  \
+    const int keys[] = {__VA_ARGS__};                                \
+    trace(keys, sizeof(keys) / sizeof(keys[0]), STEP_MS, HELD_MS);   \
+  } while (0)
+
+static void testSwipeDirections()
+{
+  TRACE(60, 40, 8, 9, 10, 11, 12);
+  CHECK(seen.count == 1);
+  CHECK(seen.eventName == "swipe");
+  CHECK(seen.direction == "E");
+  CHECK(seen.fromKey == 8 && seen.toKey == 12);
+  CHECK(seen.path == 0x1f00ULL);
+  CHECK(seen.durationMs == 240);
+
+  TRACE(60, 40, 12, 11, 10);
+  CHECK(seen.count == 1 && seen.direction == "W");
+
+  TRACE(60, 40, 59, 51, 43, 35);
+  CHECK(seen.count == 1 && seen.direction == "N");
+
+  TRACE(60, 40, 3, 11, 19);
+  CHECK(seen.count == 1 && seen.direction == "S");
+
+  TRACE(60, 40, 0, 9, 18, 27);
+  CHECK(seen.count == 1 && seen.direction == "SE");
+  CHECK(seen.path == (bitboardBit(0) | bitboardBit(9) | bitboardBit(18) | bitboardBit(27)));
+
+  TRACE(60, 40, 56, 49, 42);
+  CHECK(seen.count == 1 && seen.direction == "NE");
+
+  TRACE(60, 40, 7, 14, 21);
+  CHECK(seen.count == 1 && seen.direction == "SW");
+
+  TRACE(60, 40, 63, 54, 45);
+  CHECK(seen.count == 1 && seen.direction == "NW");
+}
+
+static void testSwipeSpeed()
+{
+  // swipeMaxMsPerKey is 120: 3 keys may take up to 240 ms
+  TRACE(120, 40, 16, 17, 18);
+  CHECK(seen.count == 1 && seen.direction == "E" && seen.durationMs == 240);
+
+  // too slow for a swipe, and the finger left the keys in between, so no drag either
+  TRACE(121, 40, 16, 17, 18);
+  CHECK(seen.count == 0);
+
+  // keys further apart than swipeStepMaxMs are separate trails
+  TRACE(400, 40, 16, 17, 18);
+  CHECK(seen.count == 0);
+
+  // too short
+  TRACE(60, 40, 16, 17);
+  CHECK(seen.count == 0);
+
+  // releases seen after the next press still count as a quick swipe
+  TRACE(60, 100, 24, 25, 26, 27);
+  CHECK(seen.count == 1 && seen.direction == "E" && seen.durationMs == 180);
+}
+
+static void testDrag()
+{
+  // slow, turns a corner, and every key went down before the previous one went up
+  TRACE(400, 500, 1, 2, 10, 18);
+  CHECK(seen.count == 1);
+  CHECK(seen.eventName == "drag");
+  CHECK(seen.direction.empty());
+  CHECK(seen.fromKey == 1 && seen.toKey == 18);
+  CHECK(seen.path == (bitboardBit(1) | bitboardBit(2) | bitboardBit(10) | bitboardBit(18)));
+  CHECK(seen.durationMs == 1200);
+
+  // straight and slow, finger down all along: a drag too
+  TRACE(400, 500, 32, 33, 34);
+  CHECK(seen.count == 1 && seen.eventName == "drag");
+
+  // quick but not straight, with the finger lifted: nothing
+  TRACE(60, 40, 1, 2, 10);
+  CHECK(seen.count == 0);
+}
+
+static void testTrailBreaks()
+{
+  // a key that is not next to the last one ends the trail right away
+  seen = SwipeSeen();
+  const uint32_t ms = hostMillis + 1000;
+  for (int i = 0; i < 3; ++i)
+  {
+    keyPress(40 + i, ms + i * 60);
+    keyRelease(40 + i, ms + i * 60 + 40);
+  }
+  CHECK(seen.count == 0);
+  keyPress(5, ms + 180);
+  CHECK(seen.count == 1 && seen.direction == "E" && seen.toKey == 42);
+  keyRelease(5, ms + 220);
+
+  // still down: trail is not idle yet
+  seen = SwipeSeen();
+  keyPress(6, ms + 240);
+  hostMillis = ms + 2000;
+  swipesFastTick();
+  keyRelease(6, ms + 2000);
+  hostMillis = ms + 3000;
+  swipesFastTick();
+  CHECK(seen.count == 0); // 2 keys only
+
+  // rows do not wrap: key 7 and key 8 are not neighbors
+  TRACE(60, 40, 6, 7, 8);
+  CHECK(seen.count == 0);
+}
+
+static void testSwipeActions()
+{
+  CHECK(!swipeActionSet("up", "scan"));
+  CHECK(swipeActionSet("E", "scan"));
+  TRACE(60, 40, 8, 9, 10);
+  CHECK(seen.count == 1 && seen.action == "scan");
+
+  CHECK(swipeActionSet("E", ""));
+  TRACE(60, 40, 8, 9, 10);
+  CHECK(seen.count == 1 && seen.action.empty());
+
+  // actions come back from nvs
+  CHECK(swipeActionSet("drag", "counter"));
+  initSwipes();
+  TRACE(400, 500, 1, 2, 10);
+  CHECK(seen.count == 1 && seen.action == "counter");
+  CHECK(swipeActionSet("drag", ""));
+}
+
+static void testBitboard()
+{
+  CHECK(bitboardNeighbors(bitboardBit(0)) == (bitboardBit(1) | bitboardBit(8) | bitboardBit(9)));
+  CHECK(bitboardCount(bitboardNeighbors(bitboardBit(27))) == 8);
+  CHECK(bitboardAdjacent(0, 9) && !bitboardAdjacent(7, 8) && !bitboardAdjacent(0, 0));
+  CHECK(bitboardEast(bitboardColumn7) == 0 && bitboardWest(bitboardColumn0) == 0);
+  CHECK(bitboardNorth(0xffULL) == 0 && bitboardSouth(0xffULL) == 0xff00ULL);
+  CHECK(bitboardFirst(0) == -1 && bitboardFirst(bitboardBit(42) | bitboardBit(63)) == 42);
+}
+
+int main()
+{
+  initSwipes();
+  testSwipeDirections();
+  testSwipeSpeed();
+  testDrag();
+  testTrailBreaks();
+  testSwipeActions();
+  testBitboard();
+  printf("swipes_test: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
@@ -0,0 +1,214 @@
+#include "check.h"
+
+// vm.cpp is pulled in whole, so the benchmark can ask vmExecute how many ops a frame took
+#include "../src/vm.cpp"
+
+// Programs are written with tools/vmasm.py; the source of each one is next to its hex.
+// First, how much of vmFrameBudget typical programs use, and what a frame costs.
+// Then, programs that break every rule vmExecute checks for.
+
+uint32_t lightsWheel(uint8_t wheelPos) { return wheelPos * 0x010101UL; }
+uint32_t lightsClockMs() { return 1000; }
+
+static const uint32_t benchFrames = 200000;
+
+static size_t parseHex(const char *hex, uint8_t *code)
+{
+  size_t codeSize = 0;
+  for (unsigned int byte; sscanf(hex, " %2x", &byte) == 1; hex += strspn(hex, " ") + 2)
+    code[codeSize++] = (uint8_t)byte;
+  return codeSize;
+}
+
+static LightUnit benchUnit(uint8_t slot)
+{
+  LightUnit unit = {0};
+  unit.id = 9;
+  unit.pixelMask = bitboardColumn0;
+  unit.color = 0xff;
+  unit.kind = lightUnitKindProgram;
+  unit.payload.program = slot;
+  unit.state.rng = prngSeed(unit.id);
+  return unit;
+}
+
+static bool loadProgram(uint8_t slot, const char *hex)
+{
+  uint8_t code[vmProgramSize * 2];
+  return vmProgramSet(slot, 0, code, parseHex(hex, code));
+}
+
+// ops the next frame of the unit runs, without touching it
+static uint32_t frameOps(uint8_t slot, const LightUnit &unit, bool &ok)
+{
+  LightUnit scratch = unit;
+  uint64_t pixels = scratch.pixelMask;
+  uint32_t ops = 0;
+  ok = vmExecute(programs[slot], scratch, pixels, ops);
+  return ops;
+}
+
+typedef struct
+{
+  const char *name;
+  const char *source;
+  const char *hex;
+  bool ok; // false => stopped by vmFrameBudget, which is the worst case of a frame
+} BenchProgram;
+
+static const BenchProgram benchPrograms[] = {
+    {"scroll", "MASK EAST SETMASK END", "19 1d 1a 00", true},
+    {"rainbow", "LOAD 0, PUSH8 8, ADD, DUP, STORE 0, WHEEL, SETCOLOR, END",
+     "17 00 01 08 07 03 18 00 24 22 00", true},
+    {"sparkle", "RANDMASK MASK AND SETMASK PUSH8 0 RAND DROP END", "28 19 0c 1a 01 00 27 04 00", true},
+    {"countdown", "PUSH8 48 loop: DUP JZ done PUSH8 1 SUB JMP loop done: DROP END",
+     "01 30 03 16 05 01 01 08 15 f8 04 00", true},
+    {"runaway", "loop: JMP loop", "15 fe", false},
+};
+
+static void benchFrameBudget()
+{
+  printf("%-10s %8s %8s %10s %8s\n", "program", "ops", "budget", "ns/frame", "ns/op");
+  for (const BenchProgram &benchProgram : benchPrograms)
+  {
+    CHECK(loadProgram(0, benchProgram.hex));
+    LightUnit unit = benchUnit(0);
+    bool ok = false;
+    const uint32_t ops = frameOps(0, unit, ok);
+    CHECK(ok == benchProgram.ok);
+
+    uint64_t pixels = unit.pixelMask;
+    uint32_t frames = 0;
+    const unsigned long startUs = micros();
+    for (uint32_t frame = 0; frame < benchFrames; ++frame)
+      frames += vmRun(unit, pixels);
+    const double frameNs = (micros() - startUs) * 1000.0 / benchFrames;
+    CHECK(frames == (benchProgram.ok ? benchFrames : 0));
+
+    printf("%-10s %8" PRIu32 " %7" PRIu32 "%% %10.1f %8.2f   %s\n", benchProgram.name, ops,
+           ops * 100 / vmFrameBudget, frameNs, ops ? frameNs / ops : 0.0, benchProgram.source);
+  }
+}
+
+static void checkPrograms()
+{
+  // runs as expected
+  CHECK(loadProgram(0, benchPrograms[0].hex));
+  LightUnit unit = benchUnit(0);
+  uint64_t pixels = unit.pixelMask;
+  CHECK(vmRun(unit, pixels) && pixels == bitboardScrollEast(bitboardColumn0));
+  CHECK(unit.state.kindStep == 1);
+
+  CHECK(loadProgram(1, benchPrograms[1].hex));
+  unit = benchUnit(1);
+  CHECK(vmRun(unit, pixels) && vmRun(unit, pixels));
+  CHECK(unit.state.kindVars[0] == 16 && unit.color == lightsWheel(16));
+
+  // division by 0 is 0, not a crash. PUSH8 5 PUSH8 0 DIV SETCOLOR END
+  CHECK(loadProgram(2, "01 05 01 00 0a 22 00"));
+  unit = benchUnit(2);
+  CHECK(vmRun(unit, pixels) && unit.color == 0);
+
+  // PUSH32 is little endian. PUSH32 0x123456 SETCOLOR END
+  CHECK(loadProgram(2, "02 56 34 12 00 22 00"));
+  unit = benchUnit(2);
+  CHECK(vmRun(unit, pixels) && unit.color == 0x123456);
+
+  // chunks: at 0 starts over, later ones append
+  CHECK(vmProgramSet(3, 0, (const uint8_t *)"\x19\x1d", 2));
+  CHECK(vmProgramSet(3, 2, (const uint8_t *)"\x1a\x00", 2));
+  CHECK(programs[3].size == 4 && memcmp(programs[3].code, "\x19\x1d\x1a\x00", 4) == 0);
+  CHECK(!vmProgramSet(3, vmProgramSize - 1, (const uint8_t *)"\x00\x00", 2));
+  CHECK(!vmProgramSet(vmProgramsMax, 0, (const uint8_t *)"\x00", 1));
+
+  // no program: unit is left alone
+  unit = benchUnit(5);
+  CHECK(!vmRun(unit, pixels));
+  unit.payload.program = vmProgramsMax;
+  CHECK(!vmRun(unit, pixels));
+}
+
+typedef struct
+{
+  const char *rule;
+  const char *source;
+  const char *hex;
+  uint32_t ops; // ops run before the program was stopped
+} BadProgram;
+
+static const BadProgram badPrograms[] = {
+    {"pop empty stack", "ADD", "07", 0},
+    {"pop empty stack", "PUSH8 1 ADD", "01 01 07", 1},
+    {"stack overflow", "loop: PUSH8 1 JMP loop", "01 01 15 fc", 2 * vmStackSize},
+    {"jump past end", "JMP 127", "15 7f", 0},
+    {"jump before start", "JMP -128", "15 80", 0},
+    {"var out of range", "LOAD 4", "17 04", 0},
+    {"var out of range", "PUSH8 1 STORE 9", "01 01 18 09", 1},
+    {"imm8 past end", "PUSH8", "01", 0},
+    {"imm32 past end", "PUSH32", "02 01 02", 0},
+    {"bad op", "0xff", "ff", 0},
+    {"over budget", "loop: JMP loop", "15 fe", vmFrameBudget},
+    {"color left alone", "PUSH8 1 SETCOLOR ADD", "01 01 22 07", 2},
+};
+
+static void checkBadPrograms()
+{
+  for (const BadProgram &badProgram : badPrograms)
+  {
+    CHECK(loadProgram(4, badProgram.hex));
+    LightUnit unit = benchUnit(4);
+    bool ok = true;
+    const uint32_t ops = frameOps(4, unit, ok);
+    uint64_t pixels = unit.pixelMask;
+    const bool ran = vmRun(unit, pixels);
+    if (ok || ran || ops != badProgram.ops || pixels != bitboardColumn0 || unit.color != 0xff)
+    {
+      printf("%s (%s): ok %d, ran %d, ops %" PRIu32 "\n", badProgram.rule, badProgram.source, ok, ran,
+             ops);
+      ++checkFailures;
+    }
+  }
+}
+
+static void checkSavedPrograms()
+{
+  // a key per slot, with only the bytes the program uses
+  Preferences preferences;
+  CHECK(vmProgramSet(3, 0, (const uint8_t *)"\x19\x1d", 2));
+  CHECK(vmProgramSet(3, 2, (const uint8_t *)"\x1a\x00", 2));
+  CHECK(preferences.getBytesLength("program3") == 4 && preferences.getBytesLength("programs") == 0);
+  CHECK(vmProgramSet(3, 0, (const uint8_t *)"", 0));
+  CHECK(preferences.getBytesLength("program3") == 0);
+
+  // too long for a slot: dropped when loaded
+  const uint8_t tooLong[vmProgramSize + 1] = {0};
+  preferences.putBytes("program5", tooLong, sizeof(tooLong));
+  CHECK(loadProgram(6, "19 1d 1a 00"));
+  initPrograms();
+  CHECK(programs[5].size == 0 && programs[6].size == 4 && memcmp(programs[6].code, "\x19\x1d\x1a\x00", 4) == 0);
+  preferences.remove("program5");
+
+  // the blob of every slot that came before: moved to a key per slot, sizes checked
+  VmProgram oldPrograms[vmProgramsMax] = {0};
+  oldPrograms[1].size = 2;
+  memcpy(oldPrograms[1].code, "\x1a\x00", 2);
+  oldPrograms[2].size = vmProgramSize + 1;
+  preferences.putBytes("programs", oldPrograms, sizeof(oldPrograms));
+  initPrograms();
+  CHECK(programs[1].size == 2 && programs[2].size == 0 && programs[6].size == 0);
+  CHECK(preferences.getBytesLength("programs") == 0 && preferences.getBytesLength("program1") == 2 &&
+        preferences.getBytesLength("program2") == 0 && preferences.getBytesLength("program6") == 0);
+  initPrograms();
+  CHECK(programs[1].size == 2 && memcmp(programs[1].code, "\x1a\x00", 2) == 0);
+}
+
+int main()
+{
+  initPrograms();
+  checkPrograms();
+  checkBadPrograms();
+  checkSavedPrograms();
+  benchFrameBudget();
+  printf("vm_bench: %s\n", checkFailures ? "FAILED" : "ok");
+  return checkFailures;
+}
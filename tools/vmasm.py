@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Assembles light unit programs into the hex that the 'program' cmd op takes.
+
+Mnemonics are the VmOp names in src/vm.h without the vmOp prefix, in any case, so
+the op list never gets out of sync with the firmware. Ops are separated by spaces,
+commas or new lines; ';' and '#' start a comment. 'name:' defines a label that
+JMP and JZ can use instead of a relative offset.
+
+  $ echo "MASK EAST SETMASK END" | tools/vmasm.py
+  19 1d 1a 00
+  $ tools/vmasm.py --slot 0 rainbow.vasm
+  {"op": "program", "slot": 0, "code": "17 00 01 08 07 03 18 00 24 22 00"}
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+VM_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'vm.h')
+IMM_SIZES = {'imm8': 1, 'rel8': 1, 'imm32': 4}
+
+
+def load_ops(path):
+    with open(path) as vm_h:
+        text = vm_h.read()
+    program_size = int(re.search(r'vmProgramSize\s*=\s*(\d+)', text).group(1))
+    ops = {}
+    for name, code, comment in re.findall(r'vmOp(\w+)\s*=\s*(0x[0-9a-fA-F]+),\s*//\s*(\S*)', text):
+        imm = comment.rstrip(',')
+        ops[name.upper()] = (int(code, 16), imm if imm in IMM_SIZES else None)
+    return ops, program_size
+
+
+def tokenize(source):
+    for line_number, line in enumerate(source.splitlines(), 1):
+        line = re.split(r'[;#]', line, 1)[0]
+        for token in re.split(r'[\s,]+', line):
+            if token:
+                yield line_number, token
+
+
+def parse_number(token):
+    try:
+        return int(token, 0)
+    except ValueError:
+        return None
+
+
+def assemble(source, ops, program_size):
+    # first pass: every op has a fixed size, so labels are known before any jump
+    items = []
+    labels = {}
+    at = 0
+    tokens = list(tokenize(source))
+    i = 0
+    while i < len(tokens):
+        line_number, token = tokens[i]
+        i += 1
+        if token.endswith(':'):
+            labels[token[:-1]] = at
+            continue
+        mnemonic = token.upper()
+        if mnemonic not in ops:
+            raise SyntaxError('line %d: unknown op %s' % (line_number, token))
+        code, imm = ops[mnemonic]
+        arg = None
+        if imm:
+            if i == len(tokens):
+                raise SyntaxError('line %d: %s needs an %s' % (line_number, mnemonic, imm))
+            arg = tokens[i][1]
+            i += 1
+        at += 1 + IMM_SIZES.get(imm, 0)
+        items.append((line_number, mnemonic, code, imm, arg, at))
+
+    code_bytes = bytearray()
+    for line_number, mnemonic, code, imm, arg, next_at in items:
+        code_bytes.append(code)
+        if not imm:
+            continue
+        value = parse_number(arg)
+        if imm == 'rel8':
+            if value is None:
+                if arg not in labels:
+                    raise SyntaxError('line %d: unknown label %s' % (line_number, arg))
+                value = labels[arg] - next_at  # relative to the op after the jump
+            if not -128 <= value <= 127:
+                raise SyntaxError('line %d: %s is too far' % (line_number, mnemonic))
+            code_bytes.append(value & 0xff)
+            continue
+        limit = 1 << (8 * IMM_SIZES[imm])
+        if value is None or not 0 <= value < limit:
+            raise SyntaxError('line %d: %s takes 0 to %d' % (line_number, mnemonic, limit - 1))
+        code_bytes += value.to_bytes(IMM_SIZES[imm], 'little')
+
+    if len(code_bytes) > program_size:
+        raise SyntaxError('program is %d bytes, max is %d' % (len(code_bytes), program_size))
+    return bytes(code_bytes)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('source', nargs='?', help='assembly file (default: stdin)')
+    parser.add_argument('--slot', type=int, help='print the whole program cmd, for this slot')
+    parser.add_argument('--vm-h', default=VM_H, help='where to read the op list from')
+    args = parser.parse_args()
+
+    ops, program_size = load_ops(args.vm_h)
+    source = open(args.source).read() if args.source else sys.stdin.read()
+    try:
+        code = assemble(source, ops, program_size)
+    except SyntaxError as error:
+        sys.exit('%s: %s' % (args.source or 'stdin', error))
+
+    hex_code = ' '.join('%02x' % b for b in code)
+    if args.slot is None:
+        print(hex_code)
+    else:
+        print(json.dumps({'op': 'program', 'slot': args.slot, 'code': hex_code}))
+
+
+if __name__ == '__main__':
+    main()